@@ -31,6 +31,9 @@
 #include "EPD_7in5_V2.h"
 #include "Debug.h"
 
+// Set while the panel is still running the refresh started last
+static UBYTE Refresh_Pending = 0;
+
 /******************************************************************************
 function :	Software reset
 parameter:
@@ -98,9 +101,42 @@ parameter:
 ******************************************************************************/
 static void EPD_7IN5_V2_TurnOnDisplay(void)
 {	
+    DEV_Busy_Clear();               //only the edge ending this refresh counts
     EPD_SendCommand(0x12);			//DISPLAY REFRESH
-    DEV_Delay_ms(100);	        //!!!The delay here is necessary, 200uS at least!!!
-    EPD_WaitUntilIdle();
+    DEV_Delay_ms(1);	        //!!!The delay here is necessary, 200uS at least!!!
+    Refresh_Pending = 1;        //waited for by the next command, see EPD_7IN5_V2_Busy
+}
+
+/******************************************************************************
+function :	Wait for a refresh started by TurnOnDisplay to finish
+parameter:
+******************************************************************************/
+static void EPD_WaitRefresh(void)
+{
+    if (Refresh_Pending) {
+        EPD_WaitUntilIdle();
+        Refresh_Pending = 0;
+    }
+}
+
+/******************************************************************************
+function :	Check whether the last refresh is still running, without blocking
+parameter:
+Info:       The refresh functions return as soon as the panel starts
+            updating; the caller can wait on DEV_Busy_Fd() and call this
+            when it becomes readable
+******************************************************************************/
+UBYTE EPD_7IN5_V2_Busy(void)
+{
+    if (!Refresh_Pending) {
+        return 0;
+    }
+    DEV_Busy_Clear();
+    if (!DEV_Digital_Read(EPD_BUSY_PIN)) {
+        return 1;
+    }
+    Refresh_Pending = 0;
+    return 0;
 }
 
 /******************************************************************************
@@ -109,6 +145,7 @@ parameter:
 ******************************************************************************/
 UBYTE EPD_7IN5_V2_Init(void)
 {
+    EPD_WaitRefresh();
     EPD_Reset();
     EPD_SendCommand(0x01);			//POWER SETTING
 	EPD_SendData(0x07);
@@ -159,6 +196,7 @@ UBYTE EPD_7IN5_V2_Init(void)
 
 UBYTE EPD_7IN5_V2_Init_Fast(void)
 {
+    EPD_WaitRefresh();
     EPD_Reset();
     EPD_SendCommand(0X00);			//PANNEL SETTING
     EPD_SendData(0x1F);   //KW-3f   KWR-2F	BWROTP 0f	BWOTP 1f
@@ -196,6 +234,7 @@ UBYTE EPD_7IN5_V2_Init_Fast(void)
 
 UBYTE EPD_7IN5_V2_Init_Part(void)
 {
+    EPD_WaitRefresh();
     EPD_Reset();
 
 	EPD_SendCommand(0X00);			//PANNEL SETTING
@@ -218,6 +257,7 @@ UBYTE EPD_7IN5_V2_Init_Part(void)
 */
 UBYTE EPD_7IN5_V2_Init_4Gray(void)
 {
+    EPD_WaitRefresh();
     EPD_Reset();
 
 	EPD_SendCommand(0X00);			//PANNEL SETTING
@@ -251,6 +291,7 @@ parameter:
 ******************************************************************************/
 void EPD_7IN5_V2_Clear(void)
 {
+    EPD_WaitRefresh();
     UWORD Width, Height;
     Width =(EPD_7IN5_V2_WIDTH % 8 == 0)?(EPD_7IN5_V2_WIDTH / 8 ):(EPD_7IN5_V2_WIDTH / 8 + 1);
     Height = EPD_7IN5_V2_HEIGHT;
@@ -280,6 +321,7 @@ void EPD_7IN5_V2_Clear(void)
 
 void EPD_7IN5_V2_ClearBlack(void)
 {
+    EPD_WaitRefresh();
     UWORD Width, Height;
     Width =(EPD_7IN5_V2_WIDTH % 8 == 0)?(EPD_7IN5_V2_WIDTH / 8 ):(EPD_7IN5_V2_WIDTH / 8 + 1);
     Height = EPD_7IN5_V2_HEIGHT;
@@ -313,6 +355,7 @@ parameter:
 ******************************************************************************/
 void EPD_7IN5_V2_Display(UBYTE *blackimage)
 {
+    EPD_WaitRefresh();
     UDOUBLE Width, Height;
     Width =(EPD_7IN5_V2_WIDTH % 8 == 0)?(EPD_7IN5_V2_WIDTH / 8 ):(EPD_7IN5_V2_WIDTH / 8 + 1);
     Height = EPD_7IN5_V2_HEIGHT;
@@ -322,20 +365,21 @@ void EPD_7IN5_V2_Display(UBYTE *blackimage)
         EPD_SendData2((UBYTE *)(blackimage+j*Width), Width);
     }
 
+    // Invert line by line so the caller's image is left untouched
+    UBYTE line[EPD_7IN5_V2_WIDTH / 8];
     EPD_SendCommand(0x13);
     for (UDOUBLE j = 0; j < Height; j++) {
         for (UDOUBLE i = 0; i < Width; i++) {
-            blackimage[i + j * Width] = ~blackimage[i + j * Width];
+            line[i] = ~blackimage[i + j * Width];
         }
-    }
-    for (UDOUBLE j = 0; j < Height; j++) {
-        EPD_SendData2((UBYTE *)(blackimage+j*Width), Width);
+        EPD_SendData2(line, Width);
     }
     EPD_7IN5_V2_TurnOnDisplay();
 }
 
 void EPD_7IN5_V2_Display_Part(UBYTE *blackimage,UDOUBLE x_start, UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end)
 {
+    EPD_WaitRefresh();
     UDOUBLE Width, Height;
     Width =((x_end - x_start) % 8 == 0)?((x_end - x_start) / 8 ):((x_end - x_start) / 8 + 1);
     Height = y_end - y_start;
@@ -349,14 +393,14 @@ void EPD_7IN5_V2_Display_Part(UBYTE *blackimage,UDOUBLE x_start, UDOUBLE y_start
 	EPD_SendData (x_start/256);
 	EPD_SendData (x_start%256);   //x-start    
 
-	EPD_SendData (x_end/256);		
-	EPD_SendData (x_end%256-1);  //x-end	
+	EPD_SendData ((x_end-1)/256);
+	EPD_SendData ((x_end-1)%256);  //x-end (inclusive)
 
 	EPD_SendData (y_start/256);  //
 	EPD_SendData (y_start%256);   //y-start    
 
-	EPD_SendData (y_end/256);		
-	EPD_SendData (y_end%256-1);  //y-end
+	EPD_SendData ((y_end-1)/256);
+	EPD_SendData ((y_end-1)%256);  //y-end (inclusive)
 	EPD_SendData (0x01);
     
     EPD_SendCommand(0x13);
@@ -368,6 +412,7 @@ void EPD_7IN5_V2_Display_Part(UBYTE *blackimage,UDOUBLE x_start, UDOUBLE y_start
 
 void EPD_7IN5_V2_Display_4Gray(const UBYTE *Image)
 {
+    EPD_WaitRefresh();
     UDOUBLE i,j,k;
     UBYTE temp1,temp2,temp3;
 
@@ -457,6 +502,7 @@ parameter:
 ******************************************************************************/
 void EPD_7IN5_V2_Sleep(void)
 {
+    EPD_WaitRefresh();
     EPD_SendCommand(0x50);  	
     EPD_SendData(0XF7);
     EPD_SendCommand(0X02);  	//power off
@@ -50,6 +50,7 @@ void EPD_7IN5_V2_Display(UBYTE *blackimage);
 void EPD_7IN5_V2_Display_Part(UBYTE *blackimage,UDOUBLE x_start, UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end);
 void EPD_7IN5_V2_Display_4Gray(const UBYTE *Image);
 void EPD_7IN5_V2_Sleep(void);
+UBYTE EPD_7IN5_V2_Busy(void);
 
 #endif
 
@@ -0,0 +1,10 @@
+#include "char_width.h"
+
+int char_width(uint32_t codepoint) {
+    // Nothing below the combining diacritics is zero width or wide
+    if (codepoint < 0x300) return 1;
+    if (codepoint > 0x10FFFF) return 1;
+
+    const uint8_t *block = char_width_blocks[char_width_index[codepoint >> 8]];
+    return (block[(codepoint & 0xFF) >> 2] >> ((codepoint & 3) * 2)) & 3;
+}
@@ -0,0 +1,15 @@
+#ifndef CHAR_WIDTH_H
+#define CHAR_WIDTH_H
+
+#include <stdint.h>
+
+// Cell width of a code point: 0 for combining and other zero-width
+// characters, 2 for East Asian wide characters and emoji, 1 otherwise.
+int char_width(uint32_t codepoint);
+
+// Generated by widthgen into char_width_table.c. char_width_index maps
+// codepoint >> 8 to a block; each block packs 2 bits per code point.
+extern const uint8_t char_width_index[0x1100];
+extern const uint8_t char_width_blocks[][64];
+
+#endif // CHAR_WIDTH_H
@@ -0,0 +1,193 @@
+#include "display.h"
+#include "EPD_7in5_V2.h"
+#include "latency.h"
+#include "log.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FB_STRIDE (EPD_7IN5_V2_WIDTH / 8)
+
+// Which init sequence the controller was last loaded with
+static enum {
+    PANEL_MODE_FULL,
+    PANEL_MODE_FAST,
+    PANEL_MODE_PART
+} panel_mode = PANEL_MODE_FULL;
+
+// How long each kind of refresh takes (ms, moving average over the last
+// few), seeded with typical figures for this panel until measured
+static unsigned long refresh_cost_ms[] = {
+    [DISPLAY_MODE_AUTO] = 0,
+    [DISPLAY_MODE_FAST] = 1500,
+    [DISPLAY_MODE_PARTIAL] = 600,
+    [DISPLAY_MODE_QUALITY] = 4000
+};
+
+// Refresh the panel is still running (AUTO: none) and when it started
+static enum display_mode refresh_running = DISPLAY_MODE_AUTO;
+static struct timespec refresh_start;
+
+static struct display_stats stats;
+
+static uint8_t *framebuffer = NULL;
+// Scratch buffer the partial window is packed into before sending
+static uint8_t *part_buffer = NULL;
+
+int display_init(uint8_t *buffer) {
+    if (!buffer) {
+        return -1;
+    }
+
+    part_buffer = malloc(FB_STRIDE * EPD_7IN5_V2_HEIGHT);
+    if (!part_buffer) {
+        log_error("display_init: failed to allocate partial buffer");
+        return -1;
+    }
+
+    framebuffer = buffer;
+    panel_mode = PANEL_MODE_FULL;
+    refresh_running = DISPLAY_MODE_AUTO;
+    return 0;
+}
+
+void display_destroy(void) {
+    free(part_buffer);
+    part_buffer = NULL;
+    framebuffer = NULL;
+}
+
+static unsigned long elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000UL +
+           (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void record_cost(enum display_mode mode, const struct timespec *start) {
+    unsigned long took = elapsed_ms(start);
+    trace(TRACE_REFRESH_DONE, mode, took);
+    latency_advance(LATENCY_REFRESH, LATENCY_INK);
+    stats.busy_ms += took;
+    // New measurement weighs a quarter
+    refresh_cost_ms[mode] = (refresh_cost_ms[mode] * 3 + took) / 4;
+}
+
+// Refreshes return once the panel has started updating; the cost is taken
+// when it reports idle again. area is the share of the panel driven, in
+// thousandths, counted as wear. Nothing is started (-1) while the last
+// refresh still runs; the main loop only sleeps in poll().
+static int start_refresh(enum display_mode mode, unsigned long area) {
+    if (display_busy()) {
+        return -1;
+    }
+    stats.refreshes[mode]++;
+    stats.wear_milli += area;
+    refresh_running = mode;
+    clock_gettime(CLOCK_MONOTONIC, &refresh_start);
+    latency_advance(LATENCY_RENDER, LATENCY_REFRESH);
+    return 0;
+}
+
+int display_busy(void) {
+    if (refresh_running == DISPLAY_MODE_AUTO) {
+        return 0;
+    }
+    if (EPD_7IN5_V2_Busy()) {
+        return 1;
+    }
+    record_cost(refresh_running, &refresh_start);
+    refresh_running = DISPLAY_MODE_AUTO;
+    return 0;
+}
+
+int display_busy_fd(void) {
+    return DEV_Busy_Fd();
+}
+
+unsigned long display_refresh_cost(enum display_mode mode) {
+    if (mode == DISPLAY_MODE_AUTO) {
+        mode = DISPLAY_MODE_PARTIAL;
+    }
+    return refresh_cost_ms[mode];
+}
+
+int display_refresh_full(void) {
+    if (!framebuffer || start_refresh(DISPLAY_MODE_QUALITY, 1000) != 0) return -1;
+
+    if (panel_mode != PANEL_MODE_FULL) {
+        EPD_7IN5_V2_Init();
+        panel_mode = PANEL_MODE_FULL;
+    }
+    EPD_7IN5_V2_Display(framebuffer);
+    return 0;
+}
+
+int display_refresh_fast(void) {
+    if (!framebuffer || start_refresh(DISPLAY_MODE_FAST, 1000) != 0) return -1;
+
+    if (panel_mode != PANEL_MODE_FAST) {
+        EPD_7IN5_V2_Init_Fast();
+        panel_mode = PANEL_MODE_FAST;
+    }
+    EPD_7IN5_V2_Display(framebuffer);
+    return 0;
+}
+
+int display_refresh_rect(const struct display_rect *rect) {
+    if (!framebuffer || !part_buffer || display_rect_is_empty(rect)) return -1;
+
+    // The controller addresses the window in whole bytes horizontally
+    int x_start = rect->x_start & ~7;
+    int x_end = (rect->x_end + 7) & ~7;
+    int y_start = rect->y_start;
+    int y_end = rect->y_end;
+
+    if (x_start < 0) x_start = 0;
+    if (y_start < 0) y_start = 0;
+    if (x_end > EPD_7IN5_V2_WIDTH) x_end = EPD_7IN5_V2_WIDTH;
+    if (y_end > EPD_7IN5_V2_HEIGHT) y_end = EPD_7IN5_V2_HEIGHT;
+
+    if (start_refresh(DISPLAY_MODE_PARTIAL,
+                      (unsigned long)(x_end - x_start) * (y_end - y_start) * 1000 /
+                      ((unsigned long)EPD_7IN5_V2_WIDTH * EPD_7IN5_V2_HEIGHT)) != 0) {
+        return -1;
+    }
+
+    int width_bytes = (x_end - x_start) / 8;
+    for (int y = y_start; y < y_end; y++) {
+        memcpy(part_buffer + (y - y_start) * width_bytes,
+               framebuffer + y * FB_STRIDE + x_start / 8,
+               width_bytes);
+    }
+
+    if (panel_mode != PANEL_MODE_PART) {
+        EPD_7IN5_V2_Init_Part();
+        panel_mode = PANEL_MODE_PART;
+    }
+    EPD_7IN5_V2_Display_Part(part_buffer, x_start, y_start, x_end, y_end);
+    return 0;
+}
+
+void display_get_stats(struct display_stats *out) {
+    *out = stats;
+}
+
+void display_rect_union(struct display_rect *rect, const struct display_rect *other) {
+    if (display_rect_is_empty(other)) return;
+    if (display_rect_is_empty(rect)) {
+        *rect = *other;
+        return;
+    }
+
+    if (other->x_start < rect->x_start) rect->x_start = other->x_start;
+    if (other->y_start < rect->y_start) rect->y_start = other->y_start;
+    if (other->x_end > rect->x_end) rect->x_end = other->x_end;
+    if (other->y_end > rect->y_end) rect->y_end = other->y_end;
+}
+
+int display_rect_is_empty(const struct display_rect *rect) {
+    return !rect || rect->x_end <= rect->x_start || rect->y_end <= rect->y_start;
+}
@@ -0,0 +1,62 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+// Pixel rectangle on the panel, end coordinates are exclusive
+struct display_rect {
+    int x_start;
+    int y_start;
+    int x_end;
+    int y_end;
+};
+
+// How frames are pushed to the panel
+enum display_mode {
+    DISPLAY_MODE_AUTO,    // partial for small changes, full for whole-grid ones
+    DISPLAY_MODE_FAST,    // whole panel with the fast waveform
+    DISPLAY_MODE_PARTIAL, // only the changed area, no flashing
+    DISPLAY_MODE_QUALITY  // whole panel with the full flashing waveform
+};
+
+// Attach the 1bpp framebuffer (1 = white) that refreshes are taken from
+int display_init(uint8_t *buffer);
+void display_destroy(void);
+
+// The refresh functions below only start the panel updating and return;
+// the framebuffer may be drawn into meanwhile. A refresh issued while the
+// last one still runs is not sent and returns -1, so callers check
+// display_busy() first or keep their damage for the next try.
+
+// Nonzero while the panel is still running the last refresh
+int display_busy(void);
+
+// fd that becomes readable when a running refresh finishes, for poll();
+// -1 if the hardware cannot report it (check display_busy periodically)
+int display_busy_fd(void);
+
+// Push the whole framebuffer with a full (flashing) refresh
+int display_refresh_full(void);
+
+// Push the whole framebuffer with the shorter fast waveform
+int display_refresh_fast(void);
+
+// Push only the given area with a partial refresh
+int display_refresh_rect(const struct display_rect *rect);
+
+// Measured duration of a refresh in the given mode (ms, moving average)
+unsigned long display_refresh_cost(enum display_mode mode);
+
+struct display_stats {
+    unsigned long refreshes[DISPLAY_MODE_QUALITY + 1];  // started, per mode
+    unsigned long long busy_ms;    // time the panel spent refreshing
+    unsigned long long wear_milli; // refreshes in thousandths of a whole-panel one
+};
+
+void display_get_stats(struct display_stats *stats);
+
+// Grow rect so it also covers other
+void display_rect_union(struct display_rect *rect, const struct display_rect *other);
+int display_rect_is_empty(const struct display_rect *rect);
+
+#endif // DISPLAY_H
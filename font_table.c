@@ -0,0 +1,33 @@
+#include "font_table.h"
+#include <string.h>
+
+const struct font_table *font_table_find(const char *name) {
+    for (int i = 0; i < font_table_count; i++) {
+        if (strcmp(font_tables[i]->name, name) == 0) {
+            return font_tables[i];
+        }
+    }
+    return NULL;
+}
+
+const uint8_t *font_table_glyph(const struct font_table *table, uint32_t codepoint) {
+    // Binary search for the last range starting at or below codepoint
+    int lo = 0, hi = table->range_count - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (table->ranges[mid].first <= codepoint) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 0) return NULL;
+
+    const struct font_range *range = &table->ranges[found];
+    uint32_t offset = codepoint - range->first;
+    if (offset >= range->count) return NULL;
+
+    size_t glyph_size = (size_t)table->cell_height * table->bytes_per_row;
+    return table->bitmaps + (range->glyph_index + offset) * glyph_size;
+}
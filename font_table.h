@@ -0,0 +1,38 @@
+#ifndef FONT_TABLE_H
+#define FONT_TABLE_H
+
+#include <stdint.h>
+
+// Bitmap fonts compiled into the binary by fontc at build time. Glyph rows
+// are bytes_per_row bytes, MSB leftmost, 1 = ink.
+
+// Consecutive code points first .. first+count-1 are glyphs glyph_index ..
+struct font_range {
+    uint32_t first;
+    uint16_t count;
+    uint16_t glyph_index;
+};
+
+struct font_table {
+    const char *name;
+    uint8_t cell_width;
+    uint8_t cell_height;
+    uint8_t baseline;       // rows from the top of the cell to the baseline
+    uint8_t bytes_per_row;
+    uint16_t glyph_count;
+    uint16_t range_count;
+    const struct font_range *ranges;   // coverage index, sorted by first
+    const uint8_t *bitmaps;            // glyph_count * cell_height * bytes_per_row
+};
+
+// Generated by fontc into font_tables.c
+extern const struct font_table *const font_tables[];
+extern const int font_table_count;
+
+// Table by name, or NULL
+const struct font_table *font_table_find(const char *name);
+
+// Glyph bitmap for code point, or NULL if the table does not cover it
+const uint8_t *font_table_glyph(const struct font_table *table, uint32_t codepoint);
+
+#endif // FONT_TABLE_H
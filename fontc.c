@@ -0,0 +1,394 @@
+// fontc - build-time font compiler
+//
+// Converts TTF/OTF/BDF/PCF (through FreeType) and PSF1/PSF2 console fonts
+// into packed const bitmap tables (see font_table.h) at a chosen cell size
+// and code point coverage, written as one C source file.
+//
+// usage: fontc -o out.c [name:font_path:WxH:ranges ...]
+//   name    table name, a C identifier ([A-Za-z_][A-Za-z0-9_]*)
+//   ranges  comma separated code points or first-last ranges (at most
+//           MAX_RANGES), e.g. 0x20-0x7e,0xa0-0xff,0x2500-0x257f
+// Without specs the output has no tables and the terminal uses its
+// built-in font.
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_CELL_WIDTH 32
+#define MAX_CELL_HEIGHT 64
+#define MAX_RANGES 64
+
+struct spec {
+    char name[64];
+    char path[512];
+    int cell_width;
+    int cell_height;
+    int range_count;
+    uint32_t range_first[MAX_RANGES];
+    uint32_t range_last[MAX_RANGES];
+};
+
+// Source font, either a FreeType face or a parsed PSF
+static FT_Library library;
+static FT_Face face;
+static uint8_t *psf_glyphs;       // psf_count glyphs of psf_height rows
+static int psf_count, psf_width, psf_height, psf_row_bytes;
+static uint32_t *psf_map_cp;      // unicode table: code point -> glyph
+static int *psf_map_glyph;
+static int psf_map_count;
+
+static int baseline;
+
+static int parse_spec(const char *arg, struct spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+
+    const char *first = strchr(arg, ':');
+    const char *last = strrchr(arg, ':');
+    if (!first || first == last) return -1;
+    const char *size = last - 1;
+    while (size > first && *size != ':') size--;
+    if (size == first) return -1;
+
+    // The name becomes part of a C identifier
+    if (first == arg || first - arg >= (int)sizeof(spec->name)) return -1;
+    for (const char *c = arg; c < first; c++) {
+        int alpha = (*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') || *c == '_';
+        if (!alpha && (c == arg || *c < '0' || *c > '9')) return -1;
+    }
+    snprintf(spec->name, sizeof(spec->name), "%.*s", (int)(first - arg), arg);
+    snprintf(spec->path, sizeof(spec->path), "%.*s", (int)(size - first - 1), first + 1);
+    if (sscanf(size + 1, "%dx%d", &spec->cell_width, &spec->cell_height) != 2) return -1;
+    if (spec->cell_width <= 0 || spec->cell_width > MAX_CELL_WIDTH ||
+        spec->cell_height <= 0 || spec->cell_height > MAX_CELL_HEIGHT) {
+        return -1;
+    }
+
+    const char *p = last + 1;
+    while (*p) {
+        if (spec->range_count == MAX_RANGES) {
+            fprintf(stderr, "fontc: %s: more than %d ranges\n", spec->name, MAX_RANGES);
+            return -1;
+        }
+        char *end;
+        uint32_t lo = strtoul(p, &end, 0);
+        uint32_t hi = lo;
+        if (end == p) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtoul(p, &end, 0);
+            if (end == p) return -1;
+        }
+        spec->range_first[spec->range_count] = lo;
+        spec->range_last[spec->range_count] = hi;
+        spec->range_count++;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return 0;
+}
+
+static void psf_add_mapping(uint32_t codepoint, int glyph) {
+    psf_map_cp = realloc(psf_map_cp, (psf_map_count + 1) * sizeof(*psf_map_cp));
+    psf_map_glyph = realloc(psf_map_glyph, (psf_map_count + 1) * sizeof(*psf_map_glyph));
+    psf_map_cp[psf_map_count] = codepoint;
+    psf_map_glyph[psf_map_count] = glyph;
+    psf_map_count++;
+}
+
+// PSF1 and PSF2 console fonts; without a unicode table glyph n is U+n
+static int load_psf(const uint8_t *data, size_t size) {
+    const uint8_t *table = NULL;
+    int has_unicode = 0, psf2 = 0;
+    size_t glyph_offset;
+
+    if (size >= 4 && data[0] == 0x36 && data[1] == 0x04) {
+        psf_count = (data[2] & 0x01) ? 512 : 256;
+        has_unicode = (data[2] & 0x06) != 0;
+        psf_height = data[3];
+        psf_width = 8;
+        glyph_offset = 4;
+    } else if (size >= 32 && data[0] == 0x72 && data[1] == 0xb5 &&
+               data[2] == 0x4a && data[3] == 0x86) {
+        const uint32_t *h = (const uint32_t *)data;
+        glyph_offset = h[2];
+        has_unicode = h[3] & 0x01;
+        psf_count = h[4];
+        psf_height = h[6];
+        psf_width = h[7];
+        psf2 = 1;
+    } else {
+        return -1;
+    }
+
+    psf_row_bytes = (psf_width + 7) / 8;
+    size_t glyph_bytes = (size_t)psf_row_bytes * psf_height;
+    if (glyph_offset + glyph_bytes * psf_count > size) return -1;
+    psf_glyphs = malloc(glyph_bytes * psf_count);
+    memcpy(psf_glyphs, data + glyph_offset, glyph_bytes * psf_count);
+    table = data + glyph_offset + glyph_bytes * psf_count;
+
+    if (!has_unicode) {
+        for (int g = 0; g < psf_count; g++) psf_add_mapping(g, g);
+        return 0;
+    }
+
+    const uint8_t *end = data + size;
+    for (int g = 0; g < psf_count && table < end; g++) {
+        int in_sequence = 0;
+        while (table < end) {
+            if (!psf2) {
+                if (table + 1 >= end) { table = end; break; }
+                uint16_t v = table[0] | (table[1] << 8);
+                table += 2;
+                if (v == 0xFFFF) break;
+                if (v == 0xFFFE) in_sequence = 1;
+                else if (!in_sequence) psf_add_mapping(v, g);
+            } else {
+                uint8_t b = *table;
+                if (b == 0xFF) { table++; break; }
+                if (b == 0xFE) { in_sequence = 1; table++; continue; }
+                // UTF-8 encoded code point
+                uint32_t cp = b;
+                int extra = (b >= 0xF0) ? 3 : (b >= 0xE0) ? 2 : (b >= 0xC0) ? 1 : 0;
+                if (extra) cp = b & (0x3F >> extra);
+                table++;
+                for (int i = 0; i < extra && table < end; i++) {
+                    cp = (cp << 6) | (*table++ & 0x3F);
+                }
+                if (!in_sequence) psf_add_mapping(cp, g);
+            }
+        }
+    }
+    return 0;
+}
+
+static int load_font(const struct spec *spec) {
+    FILE *f = fopen(spec->path, "rb");
+    if (!f) {
+        perror(spec->path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    size_t got = fread(data, 1, size, f);
+    fclose(f);
+
+    int rc = load_psf(data, got);
+    free(data);
+    if (rc == 0) {
+        // Centre the console font in the cell
+        baseline = (spec->cell_height - psf_height) / 2;
+        return 0;
+    }
+
+    if (FT_New_Face(library, spec->path, 0, &face) != 0) {
+        fprintf(stderr, "fontc: %s is neither PSF nor a FreeType font\n", spec->path);
+        return -1;
+    }
+
+    if (FT_IS_SCALABLE(face)) {
+        // Start from the cell height and shrink until the advance fits
+        int pixel_size = spec->cell_height;
+        FT_Set_Pixel_Sizes(face, 0, pixel_size);
+        if (FT_Load_Char(face, 'M', FT_LOAD_DEFAULT) == 0) {
+            int advance = face->glyph->advance.x >> 6;
+            if (advance > spec->cell_width) {
+                pixel_size = pixel_size * spec->cell_width / advance;
+                FT_Set_Pixel_Sizes(face, 0, pixel_size);
+            }
+        }
+    } else {
+        // Bitmap font (BDF/PCF): largest strike that fits the cell
+        int best = -1;
+        for (int i = 0; i < face->num_fixed_sizes; i++) {
+            if (face->available_sizes[i].height <= spec->cell_height &&
+                (best < 0 || face->available_sizes[i].height >= face->available_sizes[best].height)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            fprintf(stderr, "fontc: %s: no strike in %s is %d pixels or less\n",
+                    spec->name, spec->path, spec->cell_height);
+            return -1;
+        }
+        FT_Select_Size(face, best);
+    }
+
+    int ascender = face->size->metrics.ascender >> 6;
+    int descender = -(face->size->metrics.descender >> 6);
+    baseline = (spec->cell_height - ascender - descender) / 2 + ascender;
+    return 0;
+}
+
+static void unload_font(void) {
+    if (face) FT_Done_Face(face);
+    face = NULL;
+    free(psf_glyphs);
+    free(psf_map_cp);
+    free(psf_map_glyph);
+    psf_glyphs = NULL;
+    psf_map_cp = NULL;
+    psf_map_glyph = NULL;
+    psf_map_count = 0;
+}
+
+// Render one code point into a cell bitmap, returns -1 if the font lacks it
+static int render_glyph(const struct spec *spec, uint32_t codepoint, uint8_t *out) {
+    int row_bytes = (spec->cell_width + 7) / 8;
+    memset(out, 0, row_bytes * spec->cell_height);
+
+    if (psf_glyphs) {
+        int glyph = -1;
+        for (int i = 0; i < psf_map_count; i++) {
+            if (psf_map_cp[i] == codepoint) {
+                glyph = psf_map_glyph[i];
+                break;
+            }
+        }
+        if (glyph < 0 || glyph >= psf_count) return -1;
+
+        const uint8_t *src = psf_glyphs + (size_t)glyph * psf_row_bytes * psf_height;
+        for (int y = 0; y < psf_height; y++) {
+            int row = baseline + y;
+            if (row < 0 || row >= spec->cell_height) continue;
+            for (int x = 0; x < psf_width && x < spec->cell_width; x++) {
+                if (src[y * psf_row_bytes + x / 8] & (0x80 >> (x % 8))) {
+                    out[row * row_bytes + x / 8] |= 0x80 >> (x % 8);
+                }
+            }
+        }
+        return 0;
+    }
+
+    FT_UInt index = FT_Get_Char_Index(face, codepoint);
+    if (index == 0) return -1;
+    if (FT_Load_Glyph(face, index, FT_LOAD_RENDER | FT_LOAD_TARGET_MONO) != 0) return -1;
+
+    const FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap *bm = &slot->bitmap;
+    for (unsigned y = 0; y < bm->rows; y++) {
+        int row = baseline - slot->bitmap_top + (int)y;
+        if (row < 0 || row >= spec->cell_height) continue;
+        const unsigned char *src = bm->buffer + y * bm->pitch;
+        for (unsigned x = 0; x < bm->width; x++) {
+            int col = slot->bitmap_left + (int)x;
+            if (col < 0 || col >= spec->cell_width) continue;
+            int ink = (bm->pixel_mode == FT_PIXEL_MODE_MONO)
+                    ? (src[x / 8] >> (7 - x % 8)) & 1
+                    : src[x] >= 128;
+            if (ink) out[row * row_bytes + col / 8] |= 0x80 >> (col % 8);
+        }
+    }
+    return 0;
+}
+
+static int compile_table(FILE *out, const struct spec *spec) {
+    if (load_font(spec) != 0) return -1;
+
+    int row_bytes = (spec->cell_width + 7) / 8;
+    int glyph_bytes = row_bytes * spec->cell_height;
+    uint8_t glyph[MAX_CELL_HEIGHT * ((MAX_CELL_WIDTH + 7) / 8)];
+
+    // Pass 1: bitmaps, remembering which code points the font covered
+    uint32_t *covered = NULL;
+    int covered_count = 0;
+    fprintf(out, "static const uint8_t %s_bitmaps[] = {\n", spec->name);
+    for (int r = 0; r < spec->range_count; r++) {
+        for (uint32_t cp = spec->range_first[r]; cp <= spec->range_last[r]; cp++) {
+            if (render_glyph(spec, cp, glyph) != 0) continue;
+            covered = realloc(covered, (covered_count + 1) * sizeof(*covered));
+            covered[covered_count++] = cp;
+            fprintf(out, "    // U+%04X\n    ", cp);
+            for (int i = 0; i < glyph_bytes; i++) {
+                fprintf(out, "0x%02X,%s", glyph[i], (i + 1) % 16 == 0 && i + 1 < glyph_bytes ? "\n    " : "");
+            }
+            fprintf(out, "\n");
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    // Pass 2: coverage index of consecutive runs
+    int range_count = 0;
+    fprintf(out, "static const struct font_range %s_ranges[] = {\n", spec->name);
+    for (int i = 0; i < covered_count; ) {
+        int j = i + 1;
+        while (j < covered_count && covered[j] == covered[j - 1] + 1 && j - i < 0xFFFF) j++;
+        fprintf(out, "    { 0x%04X, %d, %d },\n", covered[i], j - i, i);
+        range_count++;
+        i = j;
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const struct font_table %s = {\n"
+                 "    \"%s\", %d, %d, %d, %d, %d, %d, %s_ranges, %s_bitmaps\n};\n\n",
+            spec->name, spec->name, spec->cell_width, spec->cell_height,
+            baseline, row_bytes, covered_count, range_count, spec->name, spec->name);
+
+    fprintf(stderr, "fontc: %s: %dx%d, %d glyphs in %d ranges from %s\n", spec->name,
+            spec->cell_width, spec->cell_height, covered_count, range_count, spec->path);
+    free(covered);
+    unload_font();
+    return covered_count > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    int first_spec = 1;
+    if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+        out_path = argv[2];
+        first_spec = 3;
+    }
+    if (!out_path) {
+        fprintf(stderr, "usage: %s -o out.c [name:font_path:WxH:ranges ...]\n", argv[0]);
+        return 1;
+    }
+
+    struct spec *specs = calloc(argc, sizeof(*specs));
+    int spec_count = 0;
+    for (int i = first_spec; i < argc; i++) {
+        if (parse_spec(argv[i], &specs[spec_count]) != 0) {
+            fprintf(stderr, "fontc: bad spec '%s'\n", argv[i]);
+            return 1;
+        }
+        spec_count++;
+    }
+
+    if (FT_Init_FreeType(&library) != 0) {
+        fprintf(stderr, "fontc: FreeType init failed\n");
+        return 1;
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(out, "// Generated by fontc - do not edit\n#include \"font_table.h\"\n\n");
+
+    for (int i = 0; i < spec_count; i++) {
+        if (compile_table(out, &specs[i]) != 0) {
+            fclose(out);
+            remove(out_path);
+            return 1;
+        }
+    }
+
+    fprintf(out, "const struct font_table *const font_tables[] = {\n");
+    for (int i = 0; i < spec_count; i++) {
+        fprintf(out, "    &%s,\n", specs[i].name);
+    }
+    if (spec_count == 0) {
+        fprintf(out, "    NULL\n");  // C has no empty arrays
+    }
+    fprintf(out, "};\n\nconst int font_table_count = %d;\n", spec_count);
+
+    fclose(out);
+    FT_Done_FreeType(library);
+    free(specs);
+    return 0;
+}
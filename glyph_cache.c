@@ -0,0 +1,201 @@
+#include "glyph_cache.h"
+#include "log.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stdio.h>
+#include <string.h>
+
+#define GLYPH_CACHE_SIZE 512
+#define GLYPH_HASH_SIZE 1024   // power of two
+#define GLYPH_MAX_HEIGHT 32
+#define GLYPH_MAX_ROW_BYTES 8  // wide glyphs of cells up to 32 pixels wide
+#define WIDE_KEY 0x80000000u    // marks double-width entries in the key
+#define NO_ENTRY (-1)
+
+struct glyph_entry {
+    uint32_t key;       // code point, | WIDE_KEY for double-width glyphs
+    int16_t hash_next;  // next entry in the same bucket
+    int16_t lru_prev;   // towards most recently used
+    int16_t lru_next;   // towards least recently used
+    uint8_t missing;    // font has no glyph, lookup returns NULL
+    uint8_t bitmap[GLYPH_MAX_HEIGHT * GLYPH_MAX_ROW_BYTES];
+};
+
+static struct glyph_entry entries[GLYPH_CACHE_SIZE];
+static int16_t buckets[GLYPH_HASH_SIZE];
+static int16_t lru_head = NO_ENTRY;
+static int16_t lru_tail = NO_ENTRY;
+static int entries_used = 0;
+
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_evictions = 0;
+
+static FT_Library library = NULL;
+static FT_Face face = NULL;
+static int glyph_width = 0;
+static int glyph_height = 0;
+static int row_bytes = 0;
+static int baseline = 0;    // rows from the top of the cell to the baseline
+
+static unsigned hash_key(uint32_t key) {
+    return (key * 2654435761u) & (GLYPH_HASH_SIZE - 1);
+}
+
+static void lru_unlink(int16_t i) {
+    struct glyph_entry *e = &entries[i];
+    if (e->lru_prev != NO_ENTRY) entries[e->lru_prev].lru_next = e->lru_next;
+    else lru_head = e->lru_next;
+    if (e->lru_next != NO_ENTRY) entries[e->lru_next].lru_prev = e->lru_prev;
+    else lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(int16_t i) {
+    entries[i].lru_prev = NO_ENTRY;
+    entries[i].lru_next = lru_head;
+    if (lru_head != NO_ENTRY) entries[lru_head].lru_prev = i;
+    lru_head = i;
+    if (lru_tail == NO_ENTRY) lru_tail = i;
+}
+
+static void hash_remove(int16_t i) {
+    int16_t *link = &buckets[hash_key(entries[i].key)];
+    while (*link != NO_ENTRY) {
+        if (*link == i) {
+            *link = entries[i].hash_next;
+            return;
+        }
+        link = &entries[*link].hash_next;
+    }
+}
+
+// Threshold FreeType's mono rendering into the cell (or two cells for wide
+// glyphs), aligned on the baseline
+static int rasterize(uint32_t codepoint, int wide, uint8_t *bitmap) {
+    int width = wide ? glyph_width * 2 : glyph_width;
+    int stride = wide ? row_bytes * 2 : row_bytes;
+    memset(bitmap, 0, glyph_height * stride);
+    if (!face) return -1;
+
+    FT_UInt index = FT_Get_Char_Index(face, codepoint);
+    if (index == 0) return -1;
+    if (FT_Load_Glyph(face, index, FT_LOAD_RENDER | FT_LOAD_TARGET_MONO) != 0) return -1;
+
+    FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap *bm = &slot->bitmap;
+    int top = baseline - slot->bitmap_top;
+    int left = slot->bitmap_left;
+
+    for (unsigned y = 0; y < bm->rows; y++) {
+        int row = top + (int)y;
+        if (row < 0 || row >= glyph_height) continue;
+        const unsigned char *src = bm->buffer + y * bm->pitch;
+        for (unsigned x = 0; x < bm->width; x++) {
+            int col = left + (int)x;
+            if (col < 0 || col >= width) continue;
+            int ink = (bm->pixel_mode == FT_PIXEL_MODE_MONO)
+                    ? (src[x / 8] >> (7 - x % 8)) & 1
+                    : src[x] >= 128;
+            if (ink) bitmap[row * stride + col / 8] |= 0x80 >> (col % 8);
+        }
+    }
+    return 0;
+}
+
+int glyph_cache_init(const char *font_path, int cell_width, int cell_height) {
+    glyph_cache_destroy();
+
+    if (cell_width * 2 > GLYPH_MAX_ROW_BYTES * 8 || cell_height > GLYPH_MAX_HEIGHT) {
+        log_error("glyph_cache_init: unsupported cell size %dx%d", cell_width, cell_height);
+        return -1;
+    }
+    glyph_width = cell_width;
+    glyph_height = cell_height;
+    row_bytes = (cell_width + 7) / 8;
+
+    if (FT_Init_FreeType(&library) != 0) {
+        log_error("glyph_cache_init: FreeType init failed");
+        library = NULL;
+        return -1;
+    }
+    if (FT_New_Face(library, font_path, 0, &face) != 0) {
+        log_error("glyph_cache_init: cannot load %s", font_path);
+        face = NULL;
+        return -1;
+    }
+
+    // Start from the cell height and shrink until the advance fits the cell
+    int pixel_size = cell_height;
+    FT_Set_Pixel_Sizes(face, 0, pixel_size);
+    if (FT_Load_Char(face, 'M', FT_LOAD_DEFAULT) == 0) {
+        int advance = face->glyph->advance.x >> 6;
+        if (advance > cell_width) {
+            pixel_size = pixel_size * cell_width / advance;
+            FT_Set_Pixel_Sizes(face, 0, pixel_size);
+        }
+    }
+
+    int ascender = face->size->metrics.ascender >> 6;
+    int descender = -(face->size->metrics.descender >> 6);
+    baseline = (cell_height - ascender - descender) / 2 + ascender;
+
+    log_info("glyph_cache_init: %s at %dpx, baseline %d", font_path, pixel_size, baseline);
+    return 0;
+}
+
+void glyph_cache_destroy(void) {
+    if (face) FT_Done_Face(face);
+    if (library) FT_Done_FreeType(library);
+    face = NULL;
+    library = NULL;
+
+    for (int i = 0; i < GLYPH_HASH_SIZE; i++) {
+        buckets[i] = NO_ENTRY;
+    }
+    lru_head = lru_tail = NO_ENTRY;
+    entries_used = 0;
+    stat_hits = stat_misses = stat_evictions = 0;
+}
+
+const uint8_t *glyph_cache_lookup(uint32_t codepoint, int wide) {
+    uint32_t key = wide ? codepoint | WIDE_KEY : codepoint;
+    unsigned bucket = hash_key(key);
+
+    for (int16_t i = buckets[bucket]; i != NO_ENTRY; i = entries[i].hash_next) {
+        if (entries[i].key == key) {
+            stat_hits++;
+            if (lru_head != i) {
+                lru_unlink(i);
+                lru_push_front(i);
+            }
+            return entries[i].missing ? NULL : entries[i].bitmap;
+        }
+    }
+
+    // Take a free slot, or recycle the least recently used one
+    int16_t i;
+    if (entries_used < GLYPH_CACHE_SIZE) {
+        i = entries_used++;
+    } else {
+        i = lru_tail;
+        lru_unlink(i);
+        hash_remove(i);
+        stat_evictions++;
+    }
+    stat_misses++;
+
+    struct glyph_entry *e = &entries[i];
+    e->key = key;
+    e->missing = rasterize(codepoint, wide, e->bitmap) != 0;
+    e->hash_next = buckets[bucket];
+    buckets[bucket] = i;
+    lru_push_front(i);
+
+    return e->missing ? NULL : e->bitmap;
+}
+
+void glyph_cache_stats(unsigned long *hits, unsigned long *misses, unsigned long *evictions) {
+    *hits = stat_hits;
+    *misses = stat_misses;
+    *evictions = stat_evictions;
+}
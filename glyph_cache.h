@@ -0,0 +1,22 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+
+// Glyphs outside the built-in font, rasterized once through FreeType into
+// 1bpp cell bitmaps (rows of (cell_width + 7) / 8 bytes, MSB leftmost, 1 = ink) and kept in a
+// bounded LRU cache. Code points the font lacks are cached as misses too.
+
+// Load the font used for fallback glyphs; lookups return NULL if this fails
+int glyph_cache_init(const char *font_path, int cell_width, int cell_height);
+void glyph_cache_destroy(void);
+
+// Cell bitmap for code point, or NULL if no font has it. Wide glyphs span
+// two cells, so their rows are twice as many bytes. The pointer stays valid
+// until the next lookup.
+const uint8_t *glyph_cache_lookup(uint32_t codepoint, int wide);
+
+// Hits, misses (rasterizations) and evictions since init
+void glyph_cache_stats(unsigned long *hits, unsigned long *misses, unsigned long *evictions);
+
+#endif // GLYPH_CACHE_H
@@ -30,11 +30,20 @@
 #include "hwconfig.h"
 #include <lgpio.h>
 #include "lgpio_gpio.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
 
 // For use with lgpio
 int GPIO_Handle;
 int SPI_Handle;
 
+// BUSY line requested straight from the kernel with edge events (-1: read
+// through lgpio instead)
+static int Busy_Fd = -1;
+
+static uint64_t Spi_Bytes = 0;
+
 /**
  * GPIO
 **/
@@ -57,6 +66,13 @@ void DEV_Digital_Write(UWORD Pin, UBYTE Value)
 UBYTE DEV_Digital_Read(UWORD Pin)
 {
 	UBYTE Read_value = 0;  
+    if (Pin == EPD_BUSY_PIN && Busy_Fd >= 0) {
+        struct gpio_v2_line_values values = { .bits = 0, .mask = 1 };
+        if (ioctl(Busy_Fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            return 0;
+        }
+        return values.bits & 1;
+    }
     Read_value = lgGpioRead(GPIO_Handle,Pin);
 
 	return Read_value;
@@ -68,11 +84,18 @@ UBYTE DEV_Digital_Read(UWORD Pin)
 void DEV_SPI_WriteByte(uint8_t Value)
 {
     lgSpiWrite(SPI_Handle,(char*)&Value, 1);
+    Spi_Bytes++;
 }
 
 void DEV_SPI_Write_nByte(uint8_t *pData, uint32_t Len)
 {
     lgSpiWrite(SPI_Handle,(char*)pData, Len);
+    Spi_Bytes += Len;
+}
+
+uint64_t DEV_SPI_Bytes(void)
+{
+    return Spi_Bytes;
 }
 
 /**
@@ -89,6 +112,50 @@ void DEV_GPIO_Mode(UWORD Pin, UWORD Mode)
     }
 }
 
+/**
+ * BUSY line events
+**/
+// lgpio only reports edges through callback threads, so the BUSY line is
+// requested with the kernel GPIO character device instead. Its fd becomes
+// readable when BUSY rises, i.e. when the controller finishes a refresh.
+static int DEV_Busy_Request(int Pin)
+{
+    int chip = open("/dev/gpiochip0", O_RDONLY | O_CLOEXEC);
+    if (chip < 0) {
+        return -1;
+    }
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = Pin;
+    req.num_lines = 1;
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    strncpy(req.consumer, "epd-busy", sizeof(req.consumer) - 1);
+
+    int ret = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip);
+    if (ret < 0) {
+        return -1;
+    }
+    fcntl(req.fd, F_SETFL, O_NONBLOCK);
+    return req.fd;
+}
+
+int DEV_Busy_Fd(void)
+{
+    return Busy_Fd;
+}
+
+void DEV_Busy_Clear(void)
+{
+    struct gpio_v2_line_event events[16];
+    if (Busy_Fd < 0) {
+        return;
+    }
+    while (read(Busy_Fd, events, sizeof(events)) > 0) {
+    }
+}
+
 /**
  * delay x ms
 **/
@@ -133,7 +200,11 @@ void DEV_GPIO_Init(void)
     EPD_MOSI_PIN = 	231;
     EPD_SCLK_PIN = 	233;
 
-    DEV_GPIO_Mode(EPD_BUSY_PIN, 0);
+    Busy_Fd = DEV_Busy_Request(EPD_BUSY_PIN);
+    if (Busy_Fd < 0) {
+        Debug("BUSY edge events unavailable, sampling the pin\n");
+        DEV_GPIO_Mode(EPD_BUSY_PIN, 0);
+    }
 	DEV_GPIO_Mode(EPD_RST_PIN, 1);
 	DEV_GPIO_Mode(EPD_DC_PIN, 1);
     DEV_GPIO_Mode(EPD_PWR_PIN, 1);
@@ -234,5 +305,9 @@ void DEV_Module_Exit(void)
     // Close SPI and GPIO handles
     lgSpiClose(SPI_Handle);
     lgGpiochipClose(GPIO_Handle);
+    if (Busy_Fd >= 0) {
+        close(Busy_Fd);
+        Busy_Fd = -1;
+    }
 }
 
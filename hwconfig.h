@@ -59,7 +59,9 @@
 #define LFLAGS 0
 #define NUM_MAXBUF 256
 
+#ifndef EPD_SIM
 #include <lgpio.h>
+#endif
 #define LFLAGS 0
 
 /**
@@ -88,6 +90,21 @@ void DEV_SPI_WriteByte(UBYTE Value);
 void DEV_SPI_Write_nByte(uint8_t *pData, uint32_t Len);
 void DEV_Delay_ms(UDOUBLE xms);
 
+// fd that becomes readable when the BUSY pin rises (-1 if the kernel
+// cannot report edges); DEV_Busy_Clear drops the events already queued
+int DEV_Busy_Fd(void);
+void DEV_Busy_Clear(void);
+
+// Bytes sent to the panel over SPI so far
+uint64_t DEV_SPI_Bytes(void);
+
+#ifdef EPD_SIM
+// The simulated panel makes this ioctl once per bus transaction, so the
+// syscall check (syscheck.c) can count panel traffic apart from the
+// terminal's own ioctls
+#define SIM_BUS_IOCTL FIONREAD
+#endif
+
 void DEV_SPI_SendData(UBYTE Reg);
 void DEV_SPI_SendnData(UBYTE *Reg);
 UBYTE DEV_SPI_ReadData();
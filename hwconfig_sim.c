@@ -0,0 +1,196 @@
+/*****************************************************************************
+* | File      	:   hwconfig_sim.c
+* | Function    :   Simulated panel behind the hwconfig.h interface
+* | Info        :
+*   Built instead of hwconfig.c with make SIM=1. Nothing is driven: the
+*   controller commands coming over "SPI" are watched just enough to know
+*   when a refresh starts and which waveform it uses, and BUSY stays low
+*   for as long as that refresh takes on the real panel. BUSY edges are
+*   reported through a timerfd, so the main loop waits exactly as it does
+*   on the hardware.
+*
+*   Each bus transaction the driver makes (a command or data transfer
+*   framed by CS, a reset edge, a BUSY read) costs one SIM_BUS_IOCTL, so
+*   the --syscall-check budgets (syscheck.c) see how much panel traffic a
+*   key or a refresh causes, counted apart from the terminal's ioctls.
+*
+*   $EPD_SIM_REFRESH_MS makes every refresh take that long instead.
+******************************************************************************/
+#include "hwconfig.h"
+#include <stdlib.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+
+// Refresh times of the 7.5" V2 panel per waveform
+#define SIM_FULL_MS    3800
+#define SIM_FAST_MS    1500
+#define SIM_PARTIAL_MS 400
+
+// LUT selection written after command 0xE5 by the Init functions
+#define SIM_LUT_FAST    0x5A
+#define SIM_LUT_PARTIAL 0x6E
+
+int EPD_RST_PIN = 1;
+int EPD_DC_PIN = 2;
+int EPD_CS_PIN = 3;
+int EPD_BUSY_PIN = 4;
+int EPD_PWR_PIN = 5;
+int EPD_MOSI_PIN = 6;
+int EPD_SCLK_PIN = 7;
+
+static int Busy_Fd = -1;
+static UBYTE Dc_Level = 0;
+static UBYTE Last_Command = 0;
+static UDOUBLE Refresh_Ms = SIM_FULL_MS;  // waveform loaded, by its duration
+static int Fixed_Refresh_Ms = 0;
+static struct timespec Busy_Until;
+static uint64_t Spi_Bytes = 0;
+
+static int Busy_Now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec < Busy_Until.tv_sec ||
+           (now.tv_sec == Busy_Until.tv_sec && now.tv_nsec < Busy_Until.tv_nsec);
+}
+
+static void Start_Refresh(void)
+{
+    UDOUBLE ms = Fixed_Refresh_Ms ? (UDOUBLE)Fixed_Refresh_Ms : Refresh_Ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &Busy_Until);
+    Busy_Until.tv_sec += ms / 1000;
+    Busy_Until.tv_nsec += (ms % 1000) * 1000000L;
+    if (Busy_Until.tv_nsec >= 1000000000L) {
+        Busy_Until.tv_sec++;
+        Busy_Until.tv_nsec -= 1000000000L;
+    }
+
+    // BUSY rises when the timer expires
+    struct itimerspec spec = { .it_value = Busy_Until };
+    timerfd_settime(Busy_Fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+// Stand-in for the syscalls of one bus transaction on the board
+static void Sim_Bus_Op(void)
+{
+    int queued;
+    ioctl(Busy_Fd, SIM_BUS_IOCTL, &queued);
+}
+
+static void Sim_Byte(UBYTE Value)
+{
+    if (Dc_Level == 0) {
+        Last_Command = Value;
+        if (Value == 0x12) {        //DISPLAY REFRESH
+            Start_Refresh();
+        }
+    } else if (Last_Command == 0xE5) {
+        if (Value == SIM_LUT_FAST) {
+            Refresh_Ms = SIM_FAST_MS;
+        } else if (Value == SIM_LUT_PARTIAL) {
+            Refresh_Ms = SIM_PARTIAL_MS;
+        }
+    }
+}
+
+/**
+ * GPIO read and write
+**/
+void DEV_Digital_Write(UWORD Pin, UBYTE Value)
+{
+    if (Pin == EPD_DC_PIN) {
+        Dc_Level = Value;
+    } else if (Pin == EPD_CS_PIN && Value == 1) {
+        Sim_Bus_Op();   // end of a command or data transfer
+    } else if (Pin == EPD_RST_PIN) {
+        Sim_Bus_Op();
+        if (Value == 0) {
+            // Reset loads the default (full) waveform
+            Refresh_Ms = SIM_FULL_MS;
+        }
+    }
+}
+
+UBYTE DEV_Digital_Read(UWORD Pin)
+{
+    Sim_Bus_Op();
+    if (Pin == EPD_BUSY_PIN) {
+        return !Busy_Now();
+    }
+    return 0;
+}
+
+/**
+ * SPI
+**/
+void DEV_SPI_WriteByte(UBYTE Value)
+{
+    Sim_Byte(Value);
+    Spi_Bytes++;
+}
+
+void DEV_SPI_Write_nByte(uint8_t *pData, uint32_t Len)
+{
+    // Image data; only commands and their first bytes matter here
+    if (Len > 0) {
+        Sim_Byte(pData[0]);
+    }
+    Spi_Bytes += Len;
+}
+
+uint64_t DEV_SPI_Bytes(void)
+{
+    return Spi_Bytes;
+}
+
+/**
+ * BUSY line events
+**/
+int DEV_Busy_Fd(void)
+{
+    return Busy_Fd;
+}
+
+void DEV_Busy_Clear(void)
+{
+    uint64_t expirations;
+    if (Busy_Fd >= 0) {
+        while (read(Busy_Fd, &expirations, sizeof(expirations)) > 0) {
+        }
+    }
+}
+
+/**
+ * delay x ms
+**/
+void DEV_Delay_ms(UDOUBLE xms)
+{
+    struct timespec ts = { xms / 1000, (xms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+UBYTE DEV_Module_Init(void)
+{
+    Busy_Fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (Busy_Fd < 0) {
+        Debug("timerfd for the simulated BUSY line failed\n");
+        return -1;
+    }
+    const char *fixed = getenv("EPD_SIM_REFRESH_MS");
+    if (fixed) {
+        Fixed_Refresh_Ms = atoi(fixed);
+    }
+    printf("Simulated panel, no hardware is driven\r\n");
+    return 0;
+}
+
+void DEV_Module_Exit(void)
+{
+    if (Busy_Fd >= 0) {
+        close(Busy_Fd);
+        Busy_Fd = -1;
+    }
+}
@@ -1,25 +1,182 @@
 #include "keyboard.h"
+#include "log.h"
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <libudev.h>
-#include <vterm.h>
 
-static int kb_fd = -1;
+#define EVENT_BATCH 64  // input events taken per read()
+#define MAX_KEYBOARDS 8
+
+// An open keyboard; held is its bit set of modifier_keys that are down
+struct keyboard {
+    int fd;
+    char devnode[64];
+    unsigned held;
+    int dropping;  // kernel queue overflowed, skipping to the next report
+    int monotonic; // event times are CLOCK_MONOTONIC
+};
+
+static struct keyboard keyboards[MAX_KEYBOARDS];
+static int keyboard_count = 0;
+
+// All keyboards and the udev monitor are watched through one epoll fd, so
+// the main loop polls a single descriptor however many are plugged in
+static int epoll_fd = -1;
+static struct udev *udev = NULL;
+static struct udev_monitor *monitor = NULL;
+static int hotplug_pending = 0;
+
+// Events read but not handed out yet, and the keyboard they came from
+static struct input_event events[EVENT_BATCH];
+static int event_count = 0;
+static int event_pos = 0;
+static struct keyboard *event_source = NULL;
+
+// Keyboards epoll reported readable, still to be drained
+static struct keyboard *ready[MAX_KEYBOARDS];
+static int ready_count = 0;
+static int ready_pos = 0;
+
+// Modifier keys, tracked per physical key so releasing one Shift while the
+// other is held keeps Shift down
+static const struct {
+    uint16_t code;
+    int modifier;
+} modifier_keys[] = {
+    { KEY_LEFTSHIFT, KEYBOARD_MOD_SHIFT },
+    { KEY_RIGHTSHIFT, KEYBOARD_MOD_SHIFT },
+    { KEY_LEFTCTRL, KEYBOARD_MOD_CTRL },
+    { KEY_RIGHTCTRL, KEYBOARD_MOD_CTRL },
+    { KEY_LEFTALT, KEYBOARD_MOD_ALT },
+    { KEY_RIGHTALT, KEYBOARD_MOD_ALTGR },
+};
+#define MODIFIER_KEY_COUNT (int)(sizeof(modifier_keys) / sizeof(modifier_keys[0]))
+
+static int locks = 0;  // KEYBOARD_LOCK_* toggled on, shared by all keyboards
+
+static void set_led(struct keyboard *kb, int led, int on);
 
 static int is_keyboard_device(struct udev_device *dev) {
     const char *kbd = udev_device_get_property_value(dev, "ID_INPUT_KEYBOARD");
-    return (kbd && strcmp(kbd, "1") == 0);
+    const char *devnode = udev_device_get_devnode(dev);
+    // Only the event nodes can be read; their parent input device also
+    // carries the keyboard property
+    return (kbd && strcmp(kbd, "1") == 0 && devnode &&
+            strncmp(devnode, "/dev/input/event", 16) == 0);
+}
+
+static struct keyboard *find_keyboard(const char *devnode) {
+    for (int i = 0; i < keyboard_count; i++) {
+        if (strcmp(keyboards[i].devnode, devnode) == 0) {
+            return &keyboards[i];
+        }
+    }
+    return NULL;
+}
+
+static void add_keyboard(const char *devnode) {
+    if (find_keyboard(devnode)) {
+        return;
+    }
+    if (keyboard_count == MAX_KEYBOARDS) {
+        log_warn("keyboard: ignoring %s, %d keyboards already open", devnode, MAX_KEYBOARDS);
+        return;
+    }
+
+    // Read-write if allowed, for the lock LEDs
+    int fd = open(devnode, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        fd = open(devnode, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        log_warn("keyboard: open %s failed: %s", devnode, strerror(errno));
+        return;
+    }
+
+    struct keyboard *kb = &keyboards[keyboard_count];
+    memset(kb, 0, sizeof(*kb));
+    kb->fd = fd;
+    snprintf(kb->devnode, sizeof(kb->devnode), "%s", devnode);
+
+    // Event times on the clock the rest of the program measures with
+    int clock_id = CLOCK_MONOTONIC;
+    kb->monotonic = ioctl(fd, EVIOCSCLOCKID, &clock_id) == 0;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        log_error("keyboard: epoll_ctl failed: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+    keyboard_count++;
+
+    set_led(kb, LED_CAPSL, (locks & KEYBOARD_LOCK_CAPS) != 0);
+    set_led(kb, LED_NUML, (locks & KEYBOARD_LOCK_NUM) != 0);
+    log_info("keyboard: using %s", devnode);
+}
+
+static void remove_keyboard(struct keyboard *kb) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, kb->fd, NULL);
+    close(kb->fd);
+
+    // Events already read from it are dropped, and it can't stay on the
+    // ready list
+    if (event_source == kb) {
+        event_count = event_pos = 0;
+        event_source = NULL;
+    }
+    ready_pos = ready_count = 0;
+
+    // Keep the array packed; the last keyboard moves into the hole
+    struct keyboard *last = &keyboards[keyboard_count - 1];
+    if (kb != last) {
+        *kb = *last;
+        if (event_source == last) {
+            event_source = kb;
+        }
+    }
+    keyboard_count--;
 }
 
 int keyboard_init(void) {
-    struct udev *udev = udev_new();
+    udev = udev_new();
     if (!udev) {
-        fprintf(stderr, "keyboard_init: failed to create udev\n");
+        log_error("keyboard_init: failed to create udev");
+        return -1;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        log_error("keyboard_init: epoll_create1 failed: %s", strerror(errno));
+        udev_unref(udev);
+        udev = NULL;
         return -1;
     }
 
+    // Listen for hotplug before enumerating, so a keyboard plugged in
+    // meanwhile isn't missed
+    monitor = udev_monitor_new_from_netlink(udev, "udev");
+    if (monitor) {
+        udev_monitor_filter_add_match_subsystem_devtype(monitor, "input", NULL);
+        udev_monitor_enable_receiving(monitor);
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = udev_monitor_get_fd(monitor) };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+            udev_monitor_unref(monitor);
+            monitor = NULL;
+        }
+    }
+    if (!monitor) {
+        log_warn("keyboard_init: no udev monitor, keyboards plugged in later are ignored");
+    }
+
     struct udev_enumerate *enumerate = udev_enumerate_new(udev);
     udev_enumerate_add_match_subsystem(enumerate, "input");
     udev_enumerate_scan_devices(enumerate);
@@ -31,60 +188,241 @@ int keyboard_init(void) {
         const char *path = udev_list_entry_get_name(entry);
         struct udev_device *dev = udev_device_new_from_syspath(udev, path);
 
-        if (is_keyboard_device(dev)) {
-            const char *devnode = udev_device_get_devnode(dev);
-            if (devnode) {
-                kb_fd = open(devnode, O_RDONLY | O_NONBLOCK);
-                if (kb_fd >= 0) {
-                    printf("keyboard_init: using %s\n", devnode);
-                    udev_device_unref(dev);
-                    udev_enumerate_unref(enumerate);
-                    udev_unref(udev);
-                    return 0;
-                } else {
-                    perror("keyboard_init: open failed");
-                }
-            }
+        if (dev && is_keyboard_device(dev)) {
+            add_keyboard(udev_device_get_devnode(dev));
         }
 
         udev_device_unref(dev);
     }
 
     udev_enumerate_unref(enumerate);
-    udev_unref(udev);
-    return -1;
+
+    // An event source udev doesn't list as a keyboard, or a pipe of input
+    // events for a scripted session
+    const char *extra = getenv("EPD_KEYBOARD");
+    if (extra && *extra) {
+        add_keyboard(extra);
+    }
+
+    // Without a monitor there is no way to get a keyboard later
+    if (keyboard_count == 0 && !monitor) {
+        keyboard_close();
+        return -1;
+    }
+    if (keyboard_count == 0) {
+        log_info("keyboard_init: no keyboard yet, waiting for one to be plugged in");
+    }
+    return 0;
 }
 
 void keyboard_close(void) {
-    if (kb_fd >= 0) {
-        close(kb_fd);
-        kb_fd = -1;
+    while (keyboard_count > 0) {
+        remove_keyboard(&keyboards[keyboard_count - 1]);
+    }
+    if (monitor) {
+        udev_monitor_unref(monitor);
+        monitor = NULL;
     }
+    if (udev) {
+        udev_unref(udev);
+        udev = NULL;
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    event_count = event_pos = 0;
+    event_source = NULL;
+    ready_pos = ready_count = 0;
+    hotplug_pending = 0;
+}
+
+int keyboard_fd(void) {
+    return epoll_fd;
+}
+
+int keyboard_hotplug_pending(void) {
+    return hotplug_pending && monitor;
 }
 
-int read_key_event(uint32_t *keycode, int *modifiers) {
-    struct input_event ev;
-    *modifiers = 0;
-
-    while (read(kb_fd, &ev, sizeof(ev)) > 0) {
-        if (ev.type == EV_KEY && ev.value == 1) { // Key press
-            *keycode = ev.code;
-
-            switch (ev.code) {
-                case KEY_LEFTSHIFT:
-                case KEY_RIGHTSHIFT:
-                    *modifiers |= VTERM_MOD_SHIFT; break;
-                case KEY_LEFTCTRL:
-                case KEY_RIGHTCTRL:
-                    *modifiers |= VTERM_MOD_CTRL; break;
-                case KEY_LEFTALT:
-                case KEY_RIGHTALT:
-                    *modifiers |= VTERM_MOD_ALT; break;
+void keyboard_handle_hotplug(void) {
+    if (!hotplug_pending || !monitor) {
+        return;
+    }
+    hotplug_pending = 0;
+
+    struct udev_device *dev;
+    while ((dev = udev_monitor_receive_device(monitor)) != NULL) {
+        const char *action = udev_device_get_action(dev);
+        const char *devnode = udev_device_get_devnode(dev);
+
+        if (action && devnode) {
+            if (strcmp(action, "add") == 0 && is_keyboard_device(dev)) {
+                add_keyboard(devnode);
+            } else if (strcmp(action, "remove") == 0) {
+                struct keyboard *kb = find_keyboard(devnode);
+                if (kb) {
+                    log_info("keyboard: %s removed", devnode);
+                    remove_keyboard(kb);
+                }
+            }
+        }
+        udev_device_unref(dev);
+    }
+}
+
+static int current_modifiers(void) {
+    unsigned held = 0;
+    for (int i = 0; i < keyboard_count; i++) {
+        held |= keyboards[i].held;
+    }
+
+    int modifiers = locks;
+    for (int i = 0; i < MODIFIER_KEY_COUNT; i++) {
+        if (held & (1u << i)) {
+            modifiers |= modifier_keys[i].modifier;
+        }
+    }
+    return modifiers;
+}
+
+// Mirror a lock state on a keyboard's LED
+static void set_led(struct keyboard *kb, int led, int on) {
+    struct input_event ev[2];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = EV_LED;
+    ev[0].code = led;
+    ev[0].value = on;
+    ev[1].type = EV_SYN;
+    ev[1].code = SYN_REPORT;
+    if (write(kb->fd, ev, sizeof(ev)) < 0) {
+        // Not every keyboard has the LED, or it was opened read-only
+    }
+}
+
+// Events were lost: take the modifiers actually held from the kernel
+static void resync_modifiers(struct keyboard *kb) {
+    unsigned long keys[KEY_MAX / (8 * sizeof(unsigned long)) + 1];
+    memset(keys, 0, sizeof(keys));
+    kb->held = 0;
+    if (ioctl(kb->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        return;
+    }
+
+    for (int i = 0; i < MODIFIER_KEY_COUNT; i++) {
+        unsigned code = modifier_keys[i].code;
+        unsigned long bit = 1UL << (code % (8 * sizeof(unsigned long)));
+        if (keys[code / (8 * sizeof(unsigned long))] & bit) {
+            kb->held |= 1u << i;
+        }
+    }
+}
+
+// Update modifier and lock state; returns nonzero if code is a modifier or
+// lock key (those are not handed out as key presses)
+static int update_modifiers(struct keyboard *kb, uint16_t code, int value) {
+    for (int i = 0; i < MODIFIER_KEY_COUNT; i++) {
+        if (modifier_keys[i].code == code) {
+            if (value) {
+                kb->held |= 1u << i;
+            } else {
+                kb->held &= ~(1u << i);
+            }
+            return 1;
+        }
+    }
+
+    if (code == KEY_CAPSLOCK || code == KEY_NUMLOCK) {
+        // Locks toggle on the press, not on its autorepeat
+        if (value == 1) {
+            int lock = code == KEY_CAPSLOCK ? KEYBOARD_LOCK_CAPS : KEYBOARD_LOCK_NUM;
+            locks ^= lock;
+            for (int i = 0; i < keyboard_count; i++) {
+                set_led(&keyboards[i], code == KEY_CAPSLOCK ? LED_CAPSL : LED_NUML,
+                        (locks & lock) != 0);
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Refill the event array from the next keyboard with events queued. A
+// keyboard is read until it runs dry before the next one gets a turn.
+static int read_events(void) {
+    event_count = event_pos = 0;
+
+    while (1) {
+        if (event_source) {
+            ssize_t n = read(event_source->fd, events, sizeof(events));
+            if (n > 0) {
+                event_count = n / sizeof(struct input_event);
+                return 1;
+            }
+            if (n < 0 && errno == ENODEV) {
+                // Unplugged; udev's remove event may come later or not at all
+                log_info("keyboard: %s went away", event_source->devnode);
+                remove_keyboard(event_source);
+            } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_warn("read_key_event: read failed: %s", strerror(errno));
+            }
+            event_source = NULL;
+        }
+
+        if (ready_pos == ready_count) {
+            ready_pos = ready_count = 0;
+            struct epoll_event ev[MAX_KEYBOARDS + 1];
+            int n = epoll_fd >= 0 ? epoll_wait(epoll_fd, ev, MAX_KEYBOARDS + 1, 0) : 0;
+            for (int i = 0; i < n; i++) {
+                if (monitor && ev[i].data.fd == udev_monitor_get_fd(monitor)) {
+                    // Opening devices waits until the keys are handled
+                    hotplug_pending = 1;
+                    continue;
+                }
+                for (int k = 0; k < keyboard_count; k++) {
+                    if (keyboards[k].fd == ev[i].data.fd) {
+                        ready[ready_count++] = &keyboards[k];
+                    }
+                }
+            }
+            if (ready_count == 0) {
+                return 0;
             }
+        }
+        event_source = ready[ready_pos++];
+    }
+}
+
+int read_key_event(uint32_t *keycode, int *modifiers, uint64_t *time_us) {
+    while (event_pos < event_count || read_events()) {
+        struct input_event *ev = &events[event_pos++];
+        struct keyboard *kb = event_source;
+
+        if (ev->type == EV_SYN) {
+            if (ev->code == SYN_DROPPED) {
+                kb->dropping = 1;
+            } else if (ev->code == SYN_REPORT && kb->dropping) {
+                kb->dropping = 0;
+                resync_modifiers(kb);
+            }
+            continue;
+        }
+        if (kb->dropping || ev->type != EV_KEY) {
+            continue;
+        }
+        if (update_modifiers(kb, ev->code, ev->value)) {
+            continue;
+        }
 
+        // Presses and autorepeats (value 2) both type the key
+        if (ev->value != 0) {
+            *keycode = ev->code;
+            *modifiers = current_modifiers();
+            *time_us = kb->monotonic ?
+                (uint64_t)ev->input_event_sec * 1000000 + ev->input_event_usec : 0;
             return 1;
         }
     }
 
-    return 0; // No event or error
+    return 0; // Nothing queued
 }
@@ -3,10 +3,38 @@
 
 #include <stdint.h>
 
+// Open every keyboard present, plus $EPD_KEYBOARD if set, and watch for
+// keyboards being plugged in or removed. Succeeds without a keyboard as
+// long as hotplug works.
 int keyboard_init(void);
 void keyboard_close(void);
 
-// Blocks or polls for key event (depending on implementation)
-int read_key_event(uint32_t *keycode, int *modifiers);
+// fd to poll() for key events from all keyboards and for hotplug
+int keyboard_fd(void);
+
+// Nonzero once udev has reported keyboards coming or going that
+// keyboard_handle_hotplug has not dealt with yet
+int keyboard_hotplug_pending(void);
+
+// Open or close keyboards udev reported since the last call. Setting a
+// device up blocks for a while, so call it on a turn with nothing else to
+// do; it returns at once if nothing was reported.
+void keyboard_handle_hotplug(void);
+
+// Modifier and lock state passed along with each key. The first three are
+// the bits of xterm's modifier parameter (minus one).
+#define KEYBOARD_MOD_SHIFT 0x01
+#define KEYBOARD_MOD_ALT   0x02
+#define KEYBOARD_MOD_CTRL  0x04
+#define KEYBOARD_MOD_ALTGR 0x08  // right Alt, third level of the layout
+#define KEYBOARD_LOCK_CAPS 0x10
+#define KEYBOARD_LOCK_NUM  0x20
+
+// Next key press or autorepeat from any keyboard, without blocking. Events
+// are read from the kernel in batches; modifier and lock keys only update
+// the state passed along in *modifiers. *time_us is when the kernel saw
+// the key, on CLOCK_MONOTONIC (0 if the device can't report that clock).
+// Returns 0 once nothing is queued.
+int read_key_event(uint32_t *keycode, int *modifiers, uint64_t *time_us);
 
 #endif // KEYBOARD_H
@@ -1,40 +1,346 @@
 #include "keymap.h"
-#include <vterm.h>
+#include "keyboard.h"
+#include "log.h"
+#include "utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <linux/input-event-codes.h>
 
-VTermKey convert_keycode_to_vtermkey(uint32_t code) {
-    switch (code) {
-        case KEY_ENTER: return VTERM_KEY_ENTER;
-        case KEY_BACKSPACE: return VTERM_KEY_BACKSPACE;
-        case KEY_TAB: return VTERM_KEY_TAB;
-        case KEY_ESC: return VTERM_KEY_ESCAPE;
-
-        case KEY_UP: return VTERM_KEY_UP;
-        case KEY_DOWN: return VTERM_KEY_DOWN;
-        case KEY_LEFT: return VTERM_KEY_LEFT;
-        case KEY_RIGHT: return VTERM_KEY_RIGHT;
-
-        case KEY_HOME: return VTERM_KEY_HOME;
-        case KEY_END: return VTERM_KEY_END;
-        case KEY_PAGEUP: return VTERM_KEY_PAGEUP;
-        case KEY_PAGEDOWN: return VTERM_KEY_PAGEDOWN;
-        case KEY_INSERT: return VTERM_KEY_INS;
-        case KEY_DELETE: return VTERM_KEY_DEL;
-
-        case KEY_F1: return VTERM_KEY_FUNCTION(1);
-        case KEY_F2: return VTERM_KEY_FUNCTION(2);
-        case KEY_F3: return VTERM_KEY_FUNCTION(3);
-        case KEY_F4: return VTERM_KEY_FUNCTION(4);
-        case KEY_F5: return VTERM_KEY_FUNCTION(5);
-        case KEY_F6: return VTERM_KEY_FUNCTION(6);
-        case KEY_F7: return VTERM_KEY_FUNCTION(7);
-        case KEY_F8: return VTERM_KEY_FUNCTION(8);
-        case KEY_F9: return VTERM_KEY_FUNCTION(9);
-        case KEY_F10: return VTERM_KEY_FUNCTION(10);
-        case KEY_F11: return VTERM_KEY_FUNCTION(11);
-        case KEY_F12: return VTERM_KEY_FUNCTION(12);
-
-        default:
-            return VTERM_KEY_NONE;
+#define KEYMAP_KEYS 128  // evdev codes translated; keys above send nothing
+#define LEVELS 4         // plain, Shift, AltGr, Shift+AltGr
+
+#define CHORD_MODS (KEYBOARD_MOD_SHIFT | KEYBOARD_MOD_ALT | KEYBOARD_MOD_CTRL)
+
+// Characters typed by each key per level. Starts out as the US layout;
+// keymap_load replaces keys from a layout file.
+static uint32_t layout[KEYMAP_KEYS][LEVELS] = {
+    [KEY_GRAVE] = { '`', '~' },
+    [KEY_1] = { '1', '!' },
+    [KEY_2] = { '2', '@' },
+    [KEY_3] = { '3', '#' },
+    [KEY_4] = { '4', '$' },
+    [KEY_5] = { '5', '%' },
+    [KEY_6] = { '6', '^' },
+    [KEY_7] = { '7', '&' },
+    [KEY_8] = { '8', '*' },
+    [KEY_9] = { '9', '(' },
+    [KEY_0] = { '0', ')' },
+    [KEY_MINUS] = { '-', '_' },
+    [KEY_EQUAL] = { '=', '+' },
+
+    [KEY_Q] = { 'q', 'Q' },
+    [KEY_W] = { 'w', 'W' },
+    [KEY_E] = { 'e', 'E' },
+    [KEY_R] = { 'r', 'R' },
+    [KEY_T] = { 't', 'T' },
+    [KEY_Y] = { 'y', 'Y' },
+    [KEY_U] = { 'u', 'U' },
+    [KEY_I] = { 'i', 'I' },
+    [KEY_O] = { 'o', 'O' },
+    [KEY_P] = { 'p', 'P' },
+    [KEY_LEFTBRACE] = { '[', '{' },
+    [KEY_RIGHTBRACE] = { ']', '}' },
+    [KEY_BACKSLASH] = { '\\', '|' },
+
+    [KEY_A] = { 'a', 'A' },
+    [KEY_S] = { 's', 'S' },
+    [KEY_D] = { 'd', 'D' },
+    [KEY_F] = { 'f', 'F' },
+    [KEY_G] = { 'g', 'G' },
+    [KEY_H] = { 'h', 'H' },
+    [KEY_J] = { 'j', 'J' },
+    [KEY_K] = { 'k', 'K' },
+    [KEY_L] = { 'l', 'L' },
+    [KEY_SEMICOLON] = { ';', ':' },
+    [KEY_APOSTROPHE] = { '\'', '"' },
+
+    [KEY_102ND] = { '\\', '|' },
+    [KEY_Z] = { 'z', 'Z' },
+    [KEY_X] = { 'x', 'X' },
+    [KEY_C] = { 'c', 'C' },
+    [KEY_V] = { 'v', 'V' },
+    [KEY_B] = { 'b', 'B' },
+    [KEY_N] = { 'n', 'N' },
+    [KEY_M] = { 'm', 'M' },
+    [KEY_COMMA] = { ',', '<' },
+    [KEY_DOT] = { '.', '>' },
+    [KEY_SLASH] = { '/', '?' },
+
+    [KEY_SPACE] = { ' ', ' ' },
+    [KEY_ENTER] = { '\r', '\r' },
+    [KEY_TAB] = { '\t', '\t' },
+    [KEY_BACKSPACE] = { 0x7F, 0x7F },
+    [KEY_ESC] = { 0x1B, 0x1B },
+
+    [KEY_KP0] = { '0', '0' },
+    [KEY_KP1] = { '1', '1' },
+    [KEY_KP2] = { '2', '2' },
+    [KEY_KP3] = { '3', '3' },
+    [KEY_KP4] = { '4', '4' },
+    [KEY_KP5] = { '5', '5' },
+    [KEY_KP6] = { '6', '6' },
+    [KEY_KP7] = { '7', '7' },
+    [KEY_KP8] = { '8', '8' },
+    [KEY_KP9] = { '9', '9' },
+    [KEY_KPDOT] = { '.', '.' },
+    [KEY_KPPLUS] = { '+', '+' },
+    [KEY_KPMINUS] = { '-', '-' },
+    [KEY_KPASTERISK] = { '*', '*' },
+    [KEY_KPSLASH] = { '/', '/' },
+    [KEY_KPEQUAL] = { '=', '=' },
+    [KEY_KPENTER] = { '\r', '\r' },
+};
+
+// Keys that send escape sequences: CSI <final>, or CSI <number> ~ when
+// final is '~'. With modifiers the xterm parameter 1 + Shift + 2*Alt +
+// 4*Ctrl is added. Unmodified, some are sent as SS3 <final> instead.
+enum {
+    SS3_NEVER,
+    SS3_APP_CURSOR,  // in application cursor mode
+    SS3_ALWAYS
+};
+static const struct function_key {
+    uint8_t number;
+    char final;
+    uint8_t ss3;
+} function_keys[KEYMAP_KEYS] = {
+    [KEY_UP] = { 1, 'A', SS3_APP_CURSOR },
+    [KEY_DOWN] = { 1, 'B', SS3_APP_CURSOR },
+    [KEY_RIGHT] = { 1, 'C', SS3_APP_CURSOR },
+    [KEY_LEFT] = { 1, 'D', SS3_APP_CURSOR },
+    [KEY_HOME] = { 1, 'H', SS3_APP_CURSOR },
+    [KEY_END] = { 1, 'F', SS3_APP_CURSOR },
+    [KEY_INSERT] = { 2, '~', SS3_NEVER },
+    [KEY_DELETE] = { 3, '~', SS3_NEVER },
+    [KEY_PAGEUP] = { 5, '~', SS3_NEVER },
+    [KEY_PAGEDOWN] = { 6, '~', SS3_NEVER },
+    [KEY_F1] = { 1, 'P', SS3_ALWAYS },
+    [KEY_F2] = { 1, 'Q', SS3_ALWAYS },
+    [KEY_F3] = { 1, 'R', SS3_ALWAYS },
+    [KEY_F4] = { 1, 'S', SS3_ALWAYS },
+    [KEY_F5] = { 15, '~', SS3_NEVER },
+    [KEY_F6] = { 17, '~', SS3_NEVER },
+    [KEY_F7] = { 18, '~', SS3_NEVER },
+    [KEY_F8] = { 19, '~', SS3_NEVER },
+    [KEY_F9] = { 20, '~', SS3_NEVER },
+    [KEY_F10] = { 21, '~', SS3_NEVER },
+    [KEY_F11] = { 23, '~', SS3_NEVER },
+    [KEY_F12] = { 24, '~', SS3_NEVER },
+};
+
+// Keypad keys acting as navigation keys while Num Lock is off
+static const uint8_t keypad_nav[KEYMAP_KEYS] = {
+    [KEY_KP0] = KEY_INSERT,
+    [KEY_KP1] = KEY_END,
+    [KEY_KP2] = KEY_DOWN,
+    [KEY_KP3] = KEY_PAGEDOWN,
+    [KEY_KP4] = KEY_LEFT,
+    [KEY_KP6] = KEY_RIGHT,
+    [KEY_KP7] = KEY_HOME,
+    [KEY_KP8] = KEY_UP,
+    [KEY_KP9] = KEY_PAGEUP,
+    [KEY_KPDOT] = KEY_DELETE,
+};
+
+// SS3 finals of the keypad in application keypad mode
+static const char keypad_app[KEYMAP_KEYS] = {
+    [KEY_KP0] = 'p', [KEY_KP1] = 'q', [KEY_KP2] = 'r', [KEY_KP3] = 's',
+    [KEY_KP4] = 't', [KEY_KP5] = 'u', [KEY_KP6] = 'v', [KEY_KP7] = 'w',
+    [KEY_KP8] = 'x', [KEY_KP9] = 'y', [KEY_KPDOT] = 'n', [KEY_KPENTER] = 'M',
+    [KEY_KPPLUS] = 'k', [KEY_KPMINUS] = 'm', [KEY_KPASTERISK] = 'j',
+    [KEY_KPSLASH] = 'o', [KEY_KPEQUAL] = 'X',
+};
+
+// Uppercase of a lowercase letter in the scripts keymaps use (Latin,
+// Greek, Cyrillic), or 0. Caps Lock only applies to keys whose shifted
+// level is this, so keys like German ß/? are left alone. Kept free of
+// the C library's locale.
+static uint32_t upper_case(uint32_t ch) {
+    if (ch >= 'a' && ch <= 'z') return ch - 0x20;
+    if (ch >= 0xE0 && ch <= 0xFE && ch != 0xF7) return ch - 0x20;      // Latin-1
+    if (ch == 0xFF) return 0x178;
+    if ((ch >= 0x101 && ch <= 0x137) || (ch >= 0x14B && ch <= 0x177)) { // Latin Extended-A
+        return (ch & 1) ? ch - 1 : 0;
+    }
+    if ((ch >= 0x13A && ch <= 0x148) || (ch >= 0x17A && ch <= 0x17E)) {
+        return (ch & 1) ? 0 : ch - 1;
+    }
+    if (ch >= 0x3B1 && ch <= 0x3C9 && ch != 0x3C2) return ch - 0x20;   // Greek
+    if (ch >= 0x430 && ch <= 0x44F) return ch - 0x20;                  // Cyrillic
+    if (ch >= 0x450 && ch <= 0x45F) return ch - 0x50;
+    return 0;
+}
+
+// Ctrl+key as xterm sends it
+static uint32_t control_char(uint32_t ch) {
+    if (ch >= 'a' && ch <= 'z') return ch - 'a' + 1;
+    if (ch >= '@' && ch <= '_') return ch - '@';   // A-Z and @ [ \ ] ^ _
+    switch (ch) {
+        case ' ':
+        case '2': return 0x00;
+        case '3': return 0x1B;
+        case '4': return 0x1C;
+        case '5': return 0x1D;
+        case '6':
+        case '~': return 0x1E;
+        case '7':
+        case '/': return 0x1F;
+        case '8':
+        case '?': return 0x7F;
+        case 0x7F: return 0x08;  // Ctrl+Backspace
+        default: return ch;
+    }
+}
+
+int keymap_translate(uint32_t keycode, int modifiers, int modes, char *out, uint32_t *typed) {
+    *typed = 0;
+    if (keycode >= KEYMAP_KEYS) {
+        return 0;
+    }
+
+    // Keypad: navigation without Num Lock, SS3 codes in application mode
+    if (keypad_nav[keycode] && !(modifiers & KEYBOARD_LOCK_NUM)) {
+        keycode = keypad_nav[keycode];
+    } else if (keypad_app[keycode] && (modes & KEYMAP_APP_KEYPAD)) {
+        return snprintf(out, KEYMAP_MAX_BYTES, "\x1bO%c", keypad_app[keycode]);
+    }
+
+    int mods = modifiers & CHORD_MODS;
+    const struct function_key *fk = &function_keys[keycode];
+    if (fk->final) {
+        if (mods && fk->final == '~') {
+            return snprintf(out, KEYMAP_MAX_BYTES, "\x1b[%d;%d~", fk->number, 1 + mods);
+        }
+        if (mods) {
+            return snprintf(out, KEYMAP_MAX_BYTES, "\x1b[1;%d%c", 1 + mods, fk->final);
+        }
+        if (fk->ss3 == SS3_ALWAYS || (fk->ss3 == SS3_APP_CURSOR && (modes & KEYMAP_APP_CURSOR))) {
+            return snprintf(out, KEYMAP_MAX_BYTES, "\x1bO%c", fk->final);
+        }
+        if (fk->final == '~') {
+            return snprintf(out, KEYMAP_MAX_BYTES, "\x1b[%d~", fk->number);
+        }
+        return snprintf(out, KEYMAP_MAX_BYTES, "\x1b[%c", fk->final);
+    }
+
+    // Character keys. AltGr picks the third level where the layout has
+    // one and is plain Alt otherwise.
+    const uint32_t *levels = layout[keycode];
+    int level = (mods & KEYBOARD_MOD_SHIFT) ? 1 : 0;
+    if ((modifiers & KEYBOARD_MOD_ALTGR) && levels[2]) {
+        level += 2;
+    } else if (modifiers & KEYBOARD_MOD_ALTGR) {
+        mods |= KEYBOARD_MOD_ALT;
     }
+    if ((modifiers & KEYBOARD_LOCK_CAPS) && levels[1] && upper_case(levels[0]) == levels[1]) {
+        level ^= 1;
+    }
+    uint32_t ch = levels[level] ? levels[level] : levels[level & 2];
+    if (!ch) {
+        return 0;
+    }
+
+    if (ch == '\t' && (mods & KEYBOARD_MOD_SHIFT)) {
+        return snprintf(out, KEYMAP_MAX_BYTES, "\x1b[Z");
+    }
+
+    int len = 0;
+    if (mods & KEYBOARD_MOD_ALT) {
+        out[len++] = 0x1B;  // Meta sends escape
+    }
+    if (mods & KEYBOARD_MOD_CTRL) {
+        ch = control_char(ch);
+    } else if (!(mods & KEYBOARD_MOD_ALT) && ch >= 0x20 && ch != 0x7F) {
+        *typed = ch;
+    }
+    len += utf8_encode(ch, (unsigned char *)out + len);
+    return len;
+}
+
+// One character of a layout file: itself in UTF-8, U+XXXX, or - for none
+static int parse_char(const char *token, uint32_t *ch) {
+    if (strcmp(token, "-") == 0) {
+        *ch = 0;
+        return 0;
+    }
+    if ((token[0] == 'U' || token[0] == 'u') && token[1] == '+' && token[2]) {
+        char *end;
+        unsigned long value = strtoul(token + 2, &end, 16);
+        if (*end || value > 0x10FFFF) {
+            return -1;
+        }
+        *ch = value;
+        return 0;
+    }
+
+    // Exactly one well-formed UTF-8 character
+    const unsigned char *s = (const unsigned char *)token;
+    size_t expect = s[0] < 0x80 ? 1 : (s[0] & 0xE0) == 0xC0 ? 2 :
+                    (s[0] & 0xF0) == 0xE0 ? 3 : (s[0] & 0xF8) == 0xF0 ? 4 : 0;
+    if (expect == 0 || strlen(token) != expect) {
+        return -1;
+    }
+    for (size_t i = 1; i < expect; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return -1;
+        }
+    }
+    utf8_decode(s, ch);
+    return 0;
+}
+
+int keymap_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        log_error("keymap_load: cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    // Applied to a copy, so a bad file leaves the current layout alone
+    static uint32_t loaded[KEYMAP_KEYS][LEVELS];
+    memcpy(loaded, layout, sizeof(layout));
+
+    char line[256];
+    int line_number = 0;
+    int keys = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char *token = strtok(line, " \t\r\n");
+        if (!token || token[0] == '#') {
+            continue;
+        }
+
+        char *end;
+        unsigned long keycode = strtoul(token, &end, 10);
+        if (*end || keycode >= KEYMAP_KEYS || function_keys[keycode].final) {
+            log_warn("%s:%d: not a character key: %s", path, line_number, token);
+            fclose(file);
+            return -1;
+        }
+
+        uint32_t levels[LEVELS] = { 0 };
+        int count = 0;
+        while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+            if (count == LEVELS || parse_char(token, &levels[count]) != 0) {
+                log_warn("%s:%d: bad character: %s", path, line_number, token);
+                fclose(file);
+                return -1;
+            }
+            count++;
+        }
+        if (count == 0) {
+            log_warn("%s:%d: no characters for key %lu", path, line_number, keycode);
+            fclose(file);
+            return -1;
+        }
+        memcpy(loaded[keycode], levels, sizeof(levels));
+        keys++;
+    }
+    fclose(file);
+
+    memcpy(layout, loaded, sizeof(layout));
+    log_info("keymap_load: %d keys from %s", keys, path);
+    return 0;
 }
@@ -2,8 +2,26 @@
 #define KEYMAP_H
 
 #include <stdint.h>
-#include <vterm.h>
 
-VTermKey convert_keycode_to_vtermkey(uint32_t evdev_code);
+// Terminal modes that change what keys send
+#define KEYMAP_APP_CURSOR 0x01  // DECCKM: cursor keys send SS3 sequences
+#define KEYMAP_APP_KEYPAD 0x02  // DECKPAM: keypad keys send SS3 sequences
+
+// Longest translation of a single key press
+#define KEYMAP_MAX_BYTES 16
+
+// Replace the character keys of the built-in US layout with the ones
+// listed in a layout file. Each line is
+//   <evdev keycode> <plain> [<shift> [<altgr> [<shift+altgr>]]]
+// where a character is written as itself (UTF-8), as U+XXXX, or as - for
+// none. Keys not listed keep their US meaning. Returns 0 or -1.
+int keymap_load(const char *path);
+
+// Bytes a key press sends to the PTY, xterm style, given the modifier and
+// lock state from read_key_event and the KEYMAP_* modes. Writes at most
+// KEYMAP_MAX_BYTES to out and returns the count (0: the key sends nothing).
+// *typed is set to the character the key types when it is plain text (no
+// Ctrl or Alt), 0 otherwise.
+int keymap_translate(uint32_t keycode, int modifiers, int modes, char *out, uint32_t *typed);
 
 #endif // KEYMAP_H
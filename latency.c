@@ -0,0 +1,164 @@
+#include "latency.h"
+#include <string.h>
+#include <time.h>
+
+#define MAX_PENDING 32  // keys followed at once; older ones count as lost
+
+struct sample {
+    uint64_t at[LATENCY_STAGE_COUNT];  // 0: stage skipped or not reached
+    enum latency_stage stage;
+    int predicted;  // its echo was drawn locally
+};
+
+static struct sample pending[MAX_PENDING];
+static int pending_count = 0;
+
+static unsigned long buckets[LATENCY_BUCKETS + 1];  // last one: longer than the range
+static unsigned long count = 0;
+static unsigned long lost = 0;
+static uint64_t max_us = 0;
+static uint64_t stage_sum_us[LATENCY_STAGE_COUNT];
+static unsigned long stage_count[LATENCY_STAGE_COUNT];
+
+uint64_t latency_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void drop_pending(int i) {
+    memmove(&pending[i], &pending[i + 1], (pending_count - i - 1) * sizeof(pending[0]));
+    pending_count--;
+}
+
+// Keys are queued in press order, so the stale ones are at the front
+static void expire(uint64_t now) {
+    while (pending_count > 0 &&
+           now - pending[0].at[LATENCY_KEY] > (uint64_t)LATENCY_GIVE_UP_MS * 1000) {
+        drop_pending(0);
+        lost++;
+    }
+}
+
+static void record(const struct sample *s) {
+    uint64_t total = s->at[LATENCY_INK] - s->at[LATENCY_KEY];
+    unsigned long bucket = total / 1000 / LATENCY_BUCKET_MS;
+    buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS]++;
+    count++;
+    if (total > max_us) max_us = total;
+
+    // Time spent getting to each stage from the last one it went through
+    uint64_t prev = s->at[LATENCY_KEY];
+    for (int st = LATENCY_KEY + 1; st < LATENCY_STAGE_COUNT; st++) {
+        if (!s->at[st]) continue;
+        stage_sum_us[st] += s->at[st] - prev;
+        stage_count[st]++;
+        prev = s->at[st];
+    }
+}
+
+void latency_key(uint64_t time_us) {
+    uint64_t now = latency_now_us();
+    expire(now);
+    if (pending_count == MAX_PENDING) {
+        drop_pending(0);
+        lost++;
+    }
+
+    struct sample *s = &pending[pending_count++];
+    memset(s, 0, sizeof(*s));
+    // A timestamp from the future (or none) would skew every stage
+    s->at[LATENCY_KEY] = (time_us && time_us <= now) ? time_us : now;
+    s->stage = LATENCY_KEY;
+}
+
+static void advance(enum latency_stage from, enum latency_stage to, int predicted_only) {
+    if (pending_count == 0) return;
+
+    uint64_t now = latency_now_us();
+    expire(now);
+    for (int i = 0; i < pending_count; i++) {
+        struct sample *s = &pending[i];
+        if (s->stage < from || s->stage >= to) continue;
+        if (predicted_only && !s->predicted) continue;
+
+        s->at[to] = now;
+        s->stage = to;
+        if (to == LATENCY_INK) {
+            record(s);
+            drop_pending(i--);
+        }
+    }
+}
+
+void latency_advance(enum latency_stage from, enum latency_stage to) {
+    advance(from, to, 0);
+}
+
+void latency_mark_predicted(void) {
+    if (pending_count > 0) {
+        pending[pending_count - 1].predicted = 1;
+    }
+}
+
+void latency_advance_predicted(enum latency_stage from, enum latency_stage to) {
+    advance(from, to, 1);
+}
+
+// Upper edge of the bucket holding the given share of the keys, capped
+// at the slowest key seen
+static unsigned long percentile(int percent) {
+    unsigned long want = (count * percent + 99) / 100;
+    unsigned long seen = 0;
+    unsigned long edge = max_us / 1000;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= want) {
+            edge = (unsigned long)(i + 1) * LATENCY_BUCKET_MS;
+            break;
+        }
+    }
+    return edge < max_us / 1000 ? edge : max_us / 1000;
+}
+
+void latency_get_stats(struct latency_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->count = count;
+    stats->lost = lost;
+    stats->p50_ms = percentile(50);
+    stats->p90_ms = percentile(90);
+    stats->p99_ms = percentile(99);
+    stats->max_ms = max_us / 1000;
+    for (int st = 0; st < LATENCY_STAGE_COUNT; st++) {
+        if (stage_count[st]) {
+            stats->stage_ms[st] = stage_sum_us[st] / stage_count[st] / 1000;
+        }
+    }
+}
+
+void latency_report(FILE *out) {
+    static const char *stage_names[LATENCY_STAGE_COUNT] = {
+        "key", "write", "echo", "render", "refresh", "ink"
+    };
+    struct latency_stats stats;
+    latency_get_stats(&stats);
+
+    fprintf(out, "Keypress to ink: %lu keys, %lu lost, p50 %lu ms, p90 %lu ms, p99 %lu ms, max %lu ms\n",
+            stats.count, stats.lost, stats.p50_ms, stats.p90_ms, stats.p99_ms, stats.max_ms);
+    if (stats.count == 0) return;
+
+    fprintf(out, "  mean per stage:");
+    for (int st = LATENCY_KEY + 1; st < LATENCY_STAGE_COUNT; st++) {
+        fprintf(out, " %s %lu ms", stage_names[st], stats.stage_ms[st]);
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+        if (!buckets[i]) continue;
+        if (i == LATENCY_BUCKETS) {
+            fprintf(out, "  >= %d ms: %lu\n", LATENCY_BUCKETS * LATENCY_BUCKET_MS, buckets[i]);
+        } else {
+            fprintf(out, "  %4d-%4d ms: %lu\n", i * LATENCY_BUCKET_MS,
+                    (i + 1) * LATENCY_BUCKET_MS, buckets[i]);
+        }
+    }
+}
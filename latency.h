@@ -0,0 +1,63 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Keypress-to-ink latency: each key press is followed from its evdev
+// timestamp through the stages below until the refresh showing its effect
+// has finished (BUSY released), and the total goes into a histogram.
+//
+// A stage is reached by every pending key that got far enough when the
+// event happens, so a key is attributed to the first refresh after its
+// echo was parsed. The echo is approximate: any PTY output parsed after a
+// write counts as the echo of every key written so far, since the shell's
+// output can't be matched to the keys that caused it. Keys whose effect is
+// drawn locally (echo prediction, scrollback) skip the stages they don't
+// go through. Keys that never lead to a refresh are dropped after
+// LATENCY_GIVE_UP_MS.
+
+enum latency_stage {
+    LATENCY_KEY,      // evdev timestamp
+    LATENCY_WRITTEN,  // written to the PTY
+    LATENCY_ECHO,     // PTY output parsed after the write
+    LATENCY_RENDER,   // drawn into the framebuffer
+    LATENCY_REFRESH,  // refresh started
+    LATENCY_INK,      // refresh finished
+    LATENCY_STAGE_COUNT
+};
+
+#define LATENCY_GIVE_UP_MS 5000
+#define LATENCY_BUCKET_MS 10  // histogram resolution
+#define LATENCY_BUCKETS (LATENCY_GIVE_UP_MS / LATENCY_BUCKET_MS)
+
+struct latency_stats {
+    unsigned long count;   // keys that reached the panel
+    unsigned long lost;    // keys given up on or pushed out of the queue
+    unsigned long p50_ms;
+    unsigned long p90_ms;
+    unsigned long p99_ms;
+    unsigned long max_ms;
+    unsigned long stage_ms[LATENCY_STAGE_COUNT];  // mean time from the previous stage
+};
+
+// CLOCK_MONOTONIC in microseconds, the clock every stage is measured on
+uint64_t latency_now_us(void);
+
+// A key press, at its event time
+void latency_key(uint64_t time_us);
+
+// Pending keys at stage from or later (but not yet at to) reach stage to
+void latency_advance(enum latency_stage from, enum latency_stage to);
+
+// The newest key was drawn locally as a predicted echo; only such keys
+// move on with latency_advance_predicted
+void latency_mark_predicted(void);
+void latency_advance_predicted(enum latency_stage from, enum latency_stage to);
+
+void latency_get_stats(struct latency_stats *stats);
+
+// Human-readable summary with the non-empty histogram buckets
+void latency_report(FILE *out);
+
+#endif // LATENCY_H
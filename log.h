@@ -0,0 +1,47 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+// Log levels, picked at build time (make LOG_LEVEL=4 for debug output).
+// Messages above the level compile to nothing, arguments included, so
+// hot paths can keep their debug logging. Per-event diagnostics that are
+// wanted in production go to the trace ring (trace.h) instead.
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Disabled levels still type-check their format against the arguments
+#define LOG_DISCARD(fmt, ...) do { if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define log_error(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#else
+#define log_error(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define log_warn(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#else
+#define log_warn(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define log_info(fmt, ...) printf(fmt "\n", ##__VA_ARGS__)
+#else
+#define log_info(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define log_debug(fmt, ...) printf(fmt "\n", ##__VA_ARGS__)
+#else
+#define log_debug(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#endif // LOG_H
@@ -1,37 +1,167 @@
 #include "pty.h"
-#include "tsm_term.h"  // Changed from vterm.h
+#include "tsm_term.h"
 #include "keyboard.h"
 #include "keymap.h"
 #include "hwconfig.h"
 #include "EPD_7in5_V2.h"
+#include "display.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "syscheck.h"
+#include "latency.h"
+#include "log.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 #include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
-unsigned long last_input_time = 0;
-unsigned long last_refresh_time = 0;
-#define QUIET_TIMEOUT_MS 1000    // Wait 1 second after last input before refreshing
-#define MIN_REFRESH_INTERVAL_MS 500  // Minimum time between refreshes
-#define FORCE_REFRESH_TIMEOUT_MS 3000  // Force refresh after 3 seconds
+#define SYNC_UPDATE_TIMEOUT_MS 1000  // Longest a synchronized update may hold refreshes
+#define PARSE_BUDGET_BYTES 4096  // Most PTY output parsed per loop turn
+#define PARSE_BUDGET_US 5000     // Most time spent parsing per loop turn
+#define SHELL_START_TIMEOUT_MS 1000  // Longest wait for the shell's first output
+#define BUSY_POLL_MS 5           // Panel check interval when BUSY has no edge events
+#define READ_SIZE_MIN 1024       // PTY read size range, adapted to the output rate
+#define READ_SIZE_MAX 32768
+#define BURST_MIN_BYTES 4096     // Output read without the PTY running dry that counts as a burst
+#define HOTPLUG_DEFER_MAX_MS 1000  // Longest keyboard hotplug waits for a quiet turn
 
-// Global cleanup flag
-static volatile int cleanup_requested = 0;
+// What the main loop sleeps on
+enum {
+    POLL_SIGNAL,
+    POLL_TIMER,
+    POLL_PTY,
+    POLL_KEYBOARD,
+    POLL_BUSY,
+    POLL_STATS,
+    POLL_COUNT
+};
 
+// Monotonic like the timerfd, so a clock step (NTP at boot, there is no
+// RTC) can't skew the scheduler's deadlines
 unsigned long current_millis() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
 }
 
-void signal_handler(int sig) {
-    printf("\nReceived signal %d, cleaning up...\n", sig);
-    cleanup_requested = 1;
+static unsigned long current_micros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+// PTY reads grow while they come back full (more is waiting in the kernel)
+// and shrink while they come back mostly empty
+static char pty_buf[READ_SIZE_MAX];
+static size_t read_size = 4096;
+
+// Read and parse PTY output until the PTY runs dry, the output queue is
+// full or the turn's parse time is spent. Returns the bytes read, -1 once
+// the PTY is closed. *queued is what is left to parse and *drained is set
+// when the PTY was emptied.
+static ssize_t drain_pty(int pty_fd, uint8_t *image, size_t *queued, int *drained) {
+    unsigned long start = current_micros();
+    ssize_t total = 0;
+    int parsed = 0;
+    *drained = 0;
+    *queued = 0;
+
+    while (1) {
+        unsigned long used = current_micros() - start;
+        if (used >= PARSE_BUDGET_US) {
+            break;
+        }
+        size_t space = tsm_term_output_space();
+        if (space == 0) {
+            // Queue full: parse before reading more, or leave the rest in
+            // the kernel for the next turn
+            *queued = tsm_term_parse(0, PARSE_BUDGET_US - used);
+            parsed = 1;
+            if (tsm_term_output_space() == 0) {
+                break;
+            }
+            continue;
+        }
+        if (space > read_size) {
+            space = read_size;
+        }
+
+        ssize_t n = read(pty_fd, pty_buf, space);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            *drained = 1;
+            break;
+        }
+        if (n < 0 && errno == EIO) {
+            log_info("PTY closed (shell exited)");
+            return -1;
+        }
+        if (n < 0) {
+            log_error("PTY read error: %s", strerror(errno));
+            return -1;
+        }
+        if (n == 0) {
+            log_info("PTY closed (EOF)");
+            return -1;
+        }
+
+        trace(TRACE_PTY_READ, n, space);
+        tsm_term_feed_output(pty_buf, n, image);
+        total += n;
+
+        // Reads cut short by the queue say nothing about the rate
+        if ((size_t)n == read_size && read_size < READ_SIZE_MAX) {
+            read_size *= 2;
+        } else if ((size_t)n < space / 4 && read_size > READ_SIZE_MIN) {
+            read_size /= 2;
+        }
+
+        used = current_micros() - start;
+        *queued = tsm_term_parse(0, used < PARSE_BUDGET_US ? PARSE_BUDGET_US - used : 1);
+        parsed = 1;
+
+        // A short read got everything the kernel had
+        if ((size_t)n < space) {
+            *drained = 1;
+            break;
+        }
+    }
+
+    // Nothing was read or parsed: still work on what earlier turns queued
+    if (!parsed) {
+        *queued = tsm_term_parse(PARSE_BUDGET_BYTES, PARSE_BUDGET_US);
+    }
+    return total;
+}
+
+// Arm the loop's timer to fire in ms milliseconds, or disarm it (ms <= 0).
+// Setting the timer also drops any expiration it counted, so it never has
+// to be read.
+static void arm_timer(int timer_fd, long ms) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (ms > 0) {
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    }
+    timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+// Earlier of two timeouts, -1 meaning none
+static long earlier_timeout(long a, long b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return a < b ? a : b;
 }
 
 // Globals
@@ -39,85 +169,122 @@ int screen_width = 800;
 int screen_height = 480;
 
 // MAIN!
-int main (void) {
-    // Set up signal handlers for clean exit
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+int main (int argc, char *argv[]) {
+#ifdef EPD_SIM
+    if (argc > 1 && strcmp(argv[1], "--syscall-check") == 0) {
+        return syscheck_run(argc - 2, argv + 2);
+    }
+#endif
 
-    printf("Starting E-ink Terminal with TSM...\n");
+    // Termination signals are read from a signalfd in the main loop, so
+    // cleanup runs in normal context
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);  // dump the trace ring
+    sigaddset(&signals, SIGUSR2);  // print keypress-to-ink latency
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        log_error("signalfd: %s", strerror(errno));
+        return -1;
+    }
+    trace_init();
+
+    log_info("Starting E-ink Terminal with TSM...");
 
     // Set up the E-Ink Display
-    printf("Initializing hardware...\n");
+    log_info("Initializing hardware...");
     if (DEV_Module_Init() != 0) {
-        printf("Hardware init failed.\n");
+        log_error("Hardware init failed.");
         return -1;
     }
 
     // Init the e-ink display
-    printf("Initializing E-ink display...\n");
+    log_info("Initializing E-ink display...");
     if (EPD_7IN5_V2_Init() != 0) {
-        printf("E-ink display init failed.\n");
+        log_error("E-ink display init failed.");
         DEV_Module_Exit();
         return -1;
     }
     
     // Clear the display
-    printf("Clearing display...\n");
+    log_info("Clearing display...");
     EPD_7IN5_V2_Clear();
 
     // Allocate framebuffer
-    printf("Allocating framebuffer...\n");
+    log_info("Allocating framebuffer...");
     size_t buffer_size = (screen_width * screen_height / 8);
     uint8_t *image = (uint8_t *)malloc(buffer_size);
     if (!image) {
-        printf("Failed to allocate memory for framebuffer\n");
+        log_error("Failed to allocate memory for framebuffer");
         DEV_Module_Exit();
         return -1;
     }
 
     // Initialize buffer to white (all bits set to 1)
     memset(image, 0xFF, buffer_size);
-    printf("Framebuffer allocated: %zu bytes\n", buffer_size);
+    log_info("Framebuffer allocated: %zu bytes", buffer_size);
+
+    if (display_init(image) != 0) {
+        log_error("Display init failed.");
+        free(image);
+        DEV_Module_Exit();
+        return -1;
+    }
 
     // Configure Keyboard input
-    printf("Initializing keyboard...\n");
+    log_info("Initializing keyboard...");
     if (keyboard_init() != 0) {
-        printf("Keyboard init failed.\n");
+        log_error("Keyboard init failed.");
+        display_destroy();
         free(image);
         DEV_Module_Exit();
         return -1;
     }
     
     // Set up for PTY
-    printf("Setting up PTY...\n");
+    log_info("Setting up PTY...");
     char *shell = getenv("SHELL");
     if (!shell) {
         shell = "/bin/bash";
     }
-    printf("Using shell: %s\n", shell);
+    log_info("Using shell: %s", shell);
 
     char *shell_argv[] = {shell, "-i", NULL}; // -i for interactive
 
-    // Use smaller terminal size to avoid crashes
-    int term_cols = 80;  // Standard 80 columns
-    int term_rows = 24;  // Standard 24 rows
-    printf("Terminal size: %dx%d characters\n", term_cols, term_rows);
+    // Fill the whole panel with character cells of the chosen font; the
+    // hand-tuned font8x16 unless a compiled table is asked for
+    const char *font_name = getenv("EPD_FONT_TABLE");
+    if (font_name && tsm_term_set_font(font_name) != 0) {
+        log_info("Using the built-in 8x16 font");
+    }
+    const char *keymap_path = getenv("EPD_KEYMAP");
+    if (keymap_path && keymap_load(keymap_path) != 0) {
+        log_info("Using the built-in US keymap");
+    }
+    int term_cols, term_rows;
+    tsm_term_grid_for_panel(screen_width, screen_height, &term_rows, &term_cols);
+    log_info("Terminal size: %dx%d characters", term_cols, term_rows);
     
     int pty_fd = setup_pty_and_spawn(shell, shell_argv, term_rows, term_cols); 
 
     if (pty_fd < 0) {
-        fprintf(stderr, "Failed to open PTY!\n");
+        log_error("Failed to open PTY!");
+        display_destroy();
         free(image);
         keyboard_close();
         DEV_Module_Exit();
         return -1;
     }
-    printf("PTY created successfully, fd=%d\n", pty_fd);
+    log_info("PTY created successfully, fd=%d", pty_fd);
 
     // Init terminal emulator with TSM
-    printf("Initializing TSM terminal emulator...\n");
+    log_info("Initializing TSM terminal emulator...");
     if (tsm_term_init(term_rows, term_cols, pty_fd, image) != 0) {
-        fprintf(stderr, "Failed to initialize TSM terminal!\n");
+        log_error("Failed to initialize TSM terminal!");
+        display_destroy();
         free(image);
         keyboard_close();
         close(pty_fd);
@@ -125,125 +292,280 @@ int main (void) {
         return -1;
     }
 
-    printf("TSM terminal initialized successfully\n");
+    log_info("TSM terminal initialized successfully");
 
     // Set PTY to non-blocking
-    printf("Setting PTY to non-blocking mode...\n");
+    log_info("Setting PTY to non-blocking mode...");
     int flags = fcntl(pty_fd, F_GETFL, 0);
     if (flags == -1) {
-        perror("fcntl F_GETFL");
+        log_error("fcntl F_GETFL: %s", strerror(errno));
     } else {
         if (fcntl(pty_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-            perror("fcntl F_SETFL");
+            log_error("fcntl F_SETFL: %s", strerror(errno));
         }
     }
 
-    printf("Entering main loop...\n");
-    int run = 1;
-    last_input_time = current_millis();
-    last_refresh_time = last_input_time;
-    
-    // Give the shell a moment to start up and send initial prompt
-    printf("Waiting for shell to initialize...\n");
-    usleep(1000000); // 1 second - give shell more time to start
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        log_error("timerfd_create: %s", strerror(errno));
+        tsm_term_destroy();
+        display_destroy();
+        free(image);
+        keyboard_close();
+        close(pty_fd);
+        DEV_Module_Exit();
+        return -1;
+    }
+
+    // Give the shell a moment to start up and send its initial prompt
+    log_info("Waiting for shell to initialize...");
+    struct pollfd start_fd = { .fd = pty_fd, .events = POLLIN };
+    poll(&start_fd, 1, SHELL_START_TIMEOUT_MS);
     
     // Read any initial output from the shell (like the prompt)
     char buf[8192]; // Large buffer for shell startup
     ssize_t n = read(pty_fd, buf, sizeof(buf) - 1);
     if (n > 0) {
         buf[n] = '\0';
-        printf("Initial shell output: %zd bytes\n", n);
+        log_info("Initial shell output: %zd bytes", n);
         tsm_term_feed_output(buf, n, image);
-        last_input_time = current_millis();
+        tsm_term_parse(0, 0);
     } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-        printf("Error reading initial output: %s\n", strerror(errno));
+        log_warn("Error reading initial output: %s", strerror(errno));
     } else {
-        printf("No initial shell output received\n");
+        log_info("No initial shell output received");
     }
     
     // Do an initial redraw
-    printf("Performing initial redraw...\n");
+    log_info("Performing initial redraw...");
     if (image) {
-        tsm_term_redraw(image);
-        last_refresh_time = current_millis();
+        tsm_term_redraw(image, DISPLAY_MODE_QUALITY);
+    }
+    scheduler_init(current_millis());
+
+    // Statistics for local monitoring; an empty $EPD_STATS_SOCKET turns
+    // them off
+    const char *stats_path = getenv("EPD_STATS_SOCKET");
+    if (!stats_path) {
+        stats_path = STATS_SOCKET_PATH;
+    }
+    if (*stats_path) {
+        stats_init(stats_path);
     }
     
-    // Main event loop with proper buffering
-    while (run && !cleanup_requested) {
-        int activity = 0;
+    log_info("Entering main loop...");
+#ifdef EPD_SIM
+    syscheck_report();
+#endif
+    unsigned long sync_started = 0;
+    unsigned long hotplug_since = 0;
+    int output_backlog = 0;
+    size_t burst_bytes = 0;
+    int panel_busy = display_busy();
+    long wait_ms = -1;
+    struct pollfd fds[POLL_COUNT];
+
+    // Main event loop: sleep until a signal, the scheduler's timer, PTY
+    // output, a key press or the panel finishing a refresh wakes it up
+    while (1) {
+        fds[POLL_SIGNAL] = (struct pollfd){ .fd = signal_fd, .events = POLLIN };
+        fds[POLL_TIMER] = (struct pollfd){ .fd = timer_fd, .events = POLLIN };
+        // A full output queue leaves the PTY unpolled for reading, so a
+        // flood stays in the kernel and throttles the writer. Input the PTY
+        // didn't take last turn waits for it to drain.
+        short pty_events = (tsm_term_output_space() > 0 ? POLLIN : 0) |
+                           (tsm_term_input_pending() > 0 ? POLLOUT : 0);
+        fds[POLL_PTY] = (struct pollfd){
+            .fd = pty_events ? pty_fd : -1, .events = pty_events };
+        fds[POLL_KEYBOARD] = (struct pollfd){ .fd = keyboard_fd(), .events = POLLIN };
+        fds[POLL_BUSY] = (struct pollfd){
+            .fd = panel_busy ? display_busy_fd() : -1, .events = POLLIN };
+        fds[POLL_STATS] = (struct pollfd){ .fd = stats_fd(), .events = POLLIN };
+
+        // Don't sleep at all while output is still waiting to be parsed
+        int timeout = (output_backlog || wait_ms == 0) ? 0 : -1;
+        if (poll(fds, POLL_COUNT, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("poll: %s", strerror(errno));
+            break;
+        }
         unsigned long now = current_millis();
+
+        if (fds[POLL_SIGNAL].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                if (info.ssi_signo == SIGUSR1) {
+                    trace_dump();
+                } else if (info.ssi_signo == SIGUSR2) {
+                    latency_report(stdout);
+                    fflush(stdout);
+                } else {
+                    log_info("Received signal %u, cleaning up...", info.ssi_signo);
+                    break;
+                }
+            }
+        }
         
-        // Handle keyboard input (collect multiple keys if typed quickly)
-        uint32_t keycode;
-        int modifiers;
-        int keys_processed = 0;
-        
-        // Process up to 5 keys in one batch to handle fast typing
-        while (keys_processed < 5 && read_key_event(&keycode, &modifiers)) {
-            printf("Key: %u (mods=%d)\n", keycode, modifiers);
-            tsm_term_process_input(keycode, modifiers);
-            last_input_time = now;
-            activity = 1;
-            keys_processed++;
-        }
-
-        // Handle PTY output (read larger chunks)
-        n = read(pty_fd, buf, sizeof(buf) - 1);
-        if (n > 0) {
-            buf[n] = '\0';
-            printf("PTY: %zd bytes\n", n);
-            
-            tsm_term_feed_output(buf, n, image);
-            last_input_time = now;
-            activity = 1;
-        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-            fprintf(stderr, "PTY read error: %s\n", strerror(errno));
-            break;
-        } else if (n == 0) {
-            printf("PTY closed (EOF)\n");
-            break;
+        // Handle keyboard input: everything queued, fast typing included
+        int keys_read = 0;
+        if (fds[POLL_KEYBOARD].revents & POLLIN) {
+            uint32_t keycode;
+            int modifiers;
+            uint64_t key_time;
+
+            while (read_key_event(&keycode, &modifiers, &key_time)) {
+                keys_read++;
+                trace(TRACE_KEY, keycode, modifiers);
+                latency_key(key_time);
+                log_debug("Key: %u (mods=%d)", keycode, modifiers);
+                tsm_term_process_input(keycode, modifiers);
+                scheduler_note_input(now);
+            }
         }
+        tsm_term_flush_predictions();
+
+        // Drain the PTY, parsing as it comes in. Without new output, parse a
+        // bounded slice of what is still queued; keys and the refresh
+        // decision come around again before the next one.
+        size_t queued;
+        int pty_ready = (fds[POLL_PTY].revents & (POLLIN | POLLHUP | POLLERR)) && (pty_events & POLLIN);
+        if (pty_ready) {
+            int drained;
+            ssize_t got = drain_pty(pty_fd, image, &queued, &drained);
+            if (got < 0) {
+                break;
+            }
+            if (got > 0) {
+                scheduler_note_output(now, got);
+            }
 
-        // Smart refresh logic - only refresh after user stops typing/activity
+            // A stream that kept the PTY full has just run dry: tell the
+            // scheduler right away instead of letting it wait out a pause
+            burst_bytes += got;
+            if (drained) {
+                if (burst_bytes >= BURST_MIN_BYTES && queued == 0) {
+                    scheduler_note_burst_end(current_millis());
+                }
+                burst_bytes = 0;
+            }
+        } else {
+            queued = tsm_term_parse(PARSE_BUDGET_BYTES, PARSE_BUDGET_US);
+        }
+        output_backlog = queued > 0;
+
+        // This turn's keys and query replies go to the PTY in one write
+        tsm_term_flush_input();
+
+        // Nothing goes to the panel while it is still busy; damage keeps
+        // accumulating and is decided on once BUSY wakes the loop.
+        // Explicit application requests first, then the scheduler decides
+        // when and how pending damage goes out
         int should_refresh = 0;
+        enum display_mode mode = DISPLAY_MODE_AUTO;
+        enum trace_refresh_cause cause = TRACE_CAUSE_SCHEDULER;
         
-        if (tsm_term_has_pending_damage()) {
-            // There's pending damage that needs to be displayed
-            if (now - last_input_time > QUIET_TIMEOUT_MS) {
-                // User has stopped typing for a while - safe to refresh
-                should_refresh = 1;
-                printf("Refreshing display after quiet period...\n");
-            } else if (now - last_refresh_time > FORCE_REFRESH_TIMEOUT_MS) {
-                // Force refresh if too much time has passed
+        if (display_busy()) {
+            // Panel still refreshing
+        } else if (tsm_term_take_frame_complete()) {
+            // Application finished a frame or asked for a refresh - show it
+            // right away
+            sync_started = 0;
+            should_refresh = 1;
+            cause = TRACE_CAUSE_APPLICATION;
+        } else if (tsm_term_refresh_paused()) {
+            // Application asked us to leave the panel alone for now
+        } else if (tsm_term_sync_update_active()) {
+            // Application is mid-frame: hold everything until it closes the
+            // update, unless it never does
+            if (!sync_started) {
+                sync_started = now;
+            }
+            if (now - sync_started > SYNC_UPDATE_TIMEOUT_MS) {
                 should_refresh = 1;
-                printf("Force refresh due to timeout...\n");
+                sync_started = now;
+                cause = TRACE_CAUSE_SYNC_TIMEOUT;
             }
+        } else {
+            struct display_rect damage;
+            tsm_term_pending_area(&damage);
+            should_refresh = scheduler_decide(now, &damage, &mode);
         }
         
         if (should_refresh && image) {
-            tsm_term_redraw(image);
-            last_refresh_time = now;
+            enum display_mode pushed = tsm_term_redraw(image, mode);
+            trace(TRACE_REFRESH, pushed, cause);
+            scheduler_note_refresh(pushed);
+        }
+
+        // Keyboards plugged in or removed. Opening and grabbing a device
+        // takes a while, so it waits for a turn with no keys, output or
+        // refresh; the monitor fd stays readable and wakes the loop again.
+        // Under a steady stream it still gets its turn now and then.
+        if (keyboard_hotplug_pending()) {
+            if (!hotplug_since) {
+                hotplug_since = now;
+            }
+            int quiet = !keys_read && !pty_ready && !output_backlog && !should_refresh;
+            if (quiet || now - hotplug_since >= HOTPLUG_DEFER_MAX_MS) {
+                keyboard_handle_hotplug();
+                hotplug_since = 0;
+            }
+        }
+
+        if (fds[POLL_STATS].revents & POLLIN) {
+            stats_serve();
         }
 
-        // Shorter sleep for better responsiveness during typing
-        if (activity) {
-            usleep(2000);  // 2ms when there's activity
+        // When the loop has to run again if no fd wakes it first
+        panel_busy = display_busy();
+        wait_ms = -1;
+        if (panel_busy) {
+            if (display_busy_fd() < 0) {
+                wait_ms = BUSY_POLL_MS;
+            }
+        } else if (tsm_term_refresh_paused()) {
+            // Only the application can resume refreshes
+        } else if (tsm_term_sync_update_active()) {
+            unsigned long held = sync_started ? now - sync_started : 0;
+            wait_ms = held > SYNC_UPDATE_TIMEOUT_MS ? 0 : (long)(SYNC_UPDATE_TIMEOUT_MS - held) + 1;
         } else {
-            usleep(10000); // 10ms when idle
+            struct display_rect damage;
+            tsm_term_pending_area(&damage);
+            wait_ms = scheduler_next_decision(now, &damage);
         }
+        wait_ms = earlier_timeout(wait_ms, tsm_term_prediction_timeout());
+        arm_timer(timer_fd, wait_ms);
     }
     
-    printf("Exiting main loop, cleaning up...\n");
+    log_info("Exiting main loop, cleaning up...");
+#ifdef EPD_SIM
+    syscheck_report();
+#endif
+
+    struct scheduler_stats sched;
+    scheduler_get_stats(&sched);
+    log_info("Scheduler: %lu interactive, %lu settled, %lu deadline refreshes, %lu turns waited",
+           sched.decisions[SCHED_INTERACTIVE], sched.decisions[SCHED_SETTLED],
+           sched.decisions[SCHED_DEADLINE], sched.decisions[SCHED_WAIT]);
+    log_info("Refreshes: %lu partial, %lu fast, %lu full", sched.modes[DISPLAY_MODE_PARTIAL],
+           sched.modes[DISPLAY_MODE_FAST], sched.modes[DISPLAY_MODE_QUALITY]);
+    latency_report(stdout);
     
     // Clean up
-    printf("Destroying terminal\n");
+    log_info("Destroying terminal");
     tsm_term_destroy();
+    display_destroy();
     free(image);
     EPD_7IN5_V2_Sleep();
     DEV_Module_Exit();
     keyboard_close();
     close(pty_fd);
+    close(timer_fd);
+    close(signal_fd);
+    stats_close();
     
-    printf("Cleanup complete\n");
+    log_info("Cleanup complete");
     return 0;
 }
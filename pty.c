@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "pty.h"
 #include <fcntl.h>
 #include <unistd.h>
@@ -5,6 +6,7 @@
 #include <stdio.h>
 #include <termios.h>
 #include <string.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -33,6 +35,12 @@ int setup_pty_and_spawn(const char *program, char *const argv[], int rows, int c
         // CHILD PROCESS
         setsid(); // create new session
 
+        // The parent takes its signals through a signalfd with them blocked;
+        // the shell must not inherit that mask
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+
         char *slave_name = ptsname(master_fd);
         if (!slave_name) {
             perror("child ptsname");
@@ -70,4 +78,15 @@ int setup_pty_and_spawn(const char *program, char *const argv[], int rows, int c
 
     // PARENT PROCESS
     return master_fd;
-}
\ No newline at end of file
+}
+
+int pty_resize(int master_fd, int rows, int cols) {
+    struct winsize ws = {
+        .ws_row = rows,
+        .ws_col = cols,
+        .ws_xpixel = 0,
+        .ws_ypixel = 0
+    };
+    // The kernel sends SIGWINCH to the foreground process group for us
+    return ioctl(master_fd, TIOCSWINSZ, &ws);
+}
@@ -3,5 +3,6 @@
 
 int setup_pty_and_spawn(const char *program, char *const argv[], int rows,
                         int cols);
+int pty_resize(int master_fd, int rows, int cols);
 
 #endif
@@ -0,0 +1,172 @@
+#include "scheduler.h"
+#include "EPD_7in5_V2.h"
+#include <string.h>
+
+#define PANEL_AREA ((long)EPD_7IN5_V2_WIDTH * EPD_7IN5_V2_HEIGHT)
+
+#define INTERACTIVE_WINDOW_MS 1000  // damage this soon after a key is its echo
+#define INTERACTIVE_SETTLE_MS 30    // let the echo burst finish first
+#define SETTLE_MIN_MS 100           // quiet needed after light output
+#define SETTLE_MAX_MS 1000
+#define DEADLINE_FACTOR 3           // streaming output refreshes every ~3 refresh costs
+#define BULK_RATE 2048              // bytes/s of output that count as a bulk stream
+#define RATE_WINDOW_MS 250
+#define GHOST_PARTIAL_LIMIT 50      // partials before an idle full refresh is due
+#define BURST_END_SETTLE_MS 20      // quiet still needed after a stream drained
+
+static unsigned long last_input_ms = 0;
+static unsigned long last_output_ms = 0;
+static unsigned long first_damage_ms = 0;   // 0 while nothing is pending
+static unsigned long burst_end_ms = 0;      // last time a stream ran dry
+static unsigned long rate_window_start = 0;
+static unsigned long rate_window_bytes = 0;
+static struct scheduler_stats stats;
+
+// Output rate over short windows, averaged with the previous estimate
+static void update_rate(unsigned long now) {
+    unsigned long span = now - rate_window_start;
+    if (span < RATE_WINDOW_MS) return;
+
+    unsigned long rate = rate_window_bytes * 1000 / span;
+    stats.output_rate = (stats.output_rate + rate) / 2;
+    rate_window_start = now;
+    rate_window_bytes = 0;
+}
+
+void scheduler_init(unsigned long now) {
+    memset(&stats, 0, sizeof(stats));
+    last_input_ms = last_output_ms = now;
+    first_damage_ms = 0;
+    burst_end_ms = 0;
+    rate_window_start = now;
+    rate_window_bytes = 0;
+}
+
+void scheduler_note_input(unsigned long now) {
+    last_input_ms = now;
+}
+
+void scheduler_note_burst_end(unsigned long now) {
+    burst_end_ms = now;
+}
+
+void scheduler_note_output(unsigned long now, size_t bytes) {
+    last_output_ms = now;
+    rate_window_bytes += bytes;
+    update_rate(now);
+}
+
+// Waveform and timing thresholds for the pending damage
+struct plan {
+    enum display_mode mode;
+    int interactive;
+    unsigned long settle;    // quiet needed before refreshing
+    unsigned long deadline;  // damage age that forces a refresh
+};
+
+static void make_plan(unsigned long now, const struct display_rect *damage, struct plan *plan) {
+    long area = (long)(damage->x_end - damage->x_start) * (damage->y_end - damage->y_start);
+    int small = area * 16 <= PANEL_AREA;
+    int bulk = stats.output_rate >= BULK_RATE;
+    plan->interactive = small && now - last_input_ms < INTERACTIVE_WINDOW_MS;
+
+    // Waveform: the fast full-panel one once most of the panel changes (it
+    // also clears ghosting), partial otherwise, and a clean full refresh
+    // when partials have piled up and nobody is waiting on the panel
+    plan->mode = (area * 2 >= PANEL_AREA) ? DISPLAY_MODE_FAST : DISPLAY_MODE_PARTIAL;
+    if (stats.partial_since_clean >= GHOST_PARTIAL_LIMIT && !plan->interactive && !bulk) {
+        plan->mode = DISPLAY_MODE_QUALITY;
+    }
+
+    // Timing: refreshing in the middle of a burst wastes a whole refresh on
+    // a frame that is about to change, so wait for a pause that scales with
+    // what the refresh costs, but never longer than a few refreshes' worth
+    unsigned long cost = display_refresh_cost(plan->mode);
+    plan->deadline = cost * DEADLINE_FACTOR;
+    plan->settle = SETTLE_MIN_MS;
+    if (bulk) {
+        plan->settle = cost / 4;
+        if (plan->settle < SETTLE_MIN_MS) plan->settle = SETTLE_MIN_MS;
+        if (plan->settle > SETTLE_MAX_MS) plan->settle = SETTLE_MAX_MS;
+    }
+    // The stream was seen to end and nothing came after: no need to wait
+    // out the pause
+    if (burst_end_ms && burst_end_ms >= last_output_ms) {
+        plan->settle = BURST_END_SETTLE_MS;
+    }
+    if (plan->interactive) {
+        plan->settle = INTERACTIVE_SETTLE_MS;
+    }
+}
+
+static unsigned long last_activity(void) {
+    return last_input_ms > last_output_ms ? last_input_ms : last_output_ms;
+}
+
+int scheduler_decide(unsigned long now, const struct display_rect *damage,
+                     enum display_mode *mode) {
+    update_rate(now);
+    if (display_rect_is_empty(damage)) {
+        first_damage_ms = 0;
+        return 0;
+    }
+    if (!first_damage_ms) {
+        first_damage_ms = now;
+    }
+
+    struct plan plan;
+    make_plan(now, damage, &plan);
+    unsigned long quiet = now - last_activity();
+    unsigned long age = now - first_damage_ms;
+
+    enum scheduler_reason reason = SCHED_WAIT;
+    if (quiet >= plan.settle) {
+        reason = plan.interactive ? SCHED_INTERACTIVE : SCHED_SETTLED;
+    } else if (age >= plan.deadline) {
+        reason = SCHED_DEADLINE;
+    }
+    stats.decisions[reason]++;
+
+    if (reason == SCHED_WAIT) {
+        return 0;
+    }
+    stats.last_wait_ms = age;
+    *mode = plan.mode;
+    return 1;
+}
+
+long scheduler_next_decision(unsigned long now, const struct display_rect *damage) {
+    if (display_rect_is_empty(damage)) {
+        return -1;
+    }
+
+    struct plan plan;
+    make_plan(now, damage, &plan);
+    unsigned long quiet = now - last_activity();
+    unsigned long age = first_damage_ms ? now - first_damage_ms : 0;
+    if (quiet >= plan.settle || age >= plan.deadline) {
+        return 0;
+    }
+
+    unsigned long wait = plan.settle - quiet;
+    if (plan.deadline - age < wait) {
+        wait = plan.deadline - age;
+    }
+    return (long)wait;
+}
+
+void scheduler_note_refresh(enum display_mode mode) {
+    if (mode == DISPLAY_MODE_AUTO) return;  // nothing was pushed
+
+    stats.modes[mode]++;
+    if (mode == DISPLAY_MODE_PARTIAL) {
+        stats.partial_since_clean++;
+    } else {
+        stats.partial_since_clean = 0;
+    }
+    first_damage_ms = 0;
+}
+
+void scheduler_get_stats(struct scheduler_stats *out) {
+    *out = stats;
+}
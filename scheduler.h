@@ -0,0 +1,58 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "display.h"
+#include <stddef.h>
+
+// Decides when pending damage is pushed to the panel and with which
+// waveform, from the damage size, the measured cost of each refresh mode
+// and recent keyboard and PTY activity. Small changes right after a key
+// press go out almost immediately as partial refreshes; bulk output waits
+// for a pause (or a deadline scaled to the refresh cost) so the panel
+// spends most of its time showing output rather than refreshing.
+
+// Why the scheduler refreshed (or didn't)
+enum scheduler_reason {
+    SCHED_WAIT,          // damage pending, holding for more
+    SCHED_INTERACTIVE,   // small change shortly after a key press
+    SCHED_SETTLED,       // output paused long enough
+    SCHED_DEADLINE,      // output kept coming, damage got too old
+    SCHED_REASON_COUNT
+};
+
+struct scheduler_stats {
+    unsigned long decisions[SCHED_REASON_COUNT];  // loop turns per outcome
+    unsigned long modes[DISPLAY_MODE_QUALITY + 1];  // refreshes per chosen mode
+    unsigned long partial_since_clean;            // partials since the last full-panel refresh
+    unsigned long last_wait_ms;                   // damage age at the last refresh
+    unsigned long output_rate;                    // recent PTY output, bytes per second
+};
+
+void scheduler_init(unsigned long now);
+
+// Activity the decisions are based on
+void scheduler_note_input(unsigned long now);
+void scheduler_note_output(unsigned long now, size_t bytes);
+
+// Output that kept the PTY full has just run dry: the stream most likely
+// ended, so damage only waits briefly for more instead of a full pause
+void scheduler_note_burst_end(unsigned long now);
+
+// Call once per loop turn with the area that would be refreshed (empty if
+// nothing is pending). Returns nonzero when it is time to refresh, with
+// the waveform to use in *mode.
+int scheduler_decide(unsigned long now, const struct display_rect *damage,
+                     enum display_mode *mode);
+
+// Milliseconds until scheduler_decide may change its mind about the given
+// damage when nothing else happens meanwhile (-1: no damage, nothing to
+// wake up for). The main loop sleeps this long.
+long scheduler_next_decision(unsigned long now, const struct display_rect *damage);
+
+// A refresh was done in mode (DISPLAY_MODE_AUTO: nothing was pushed), by
+// the scheduler or on application request
+void scheduler_note_refresh(enum display_mode mode);
+
+void scheduler_get_stats(struct scheduler_stats *stats);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,172 @@
+#include "scrollback.h"
+#include "utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A run of cells sharing the same attributes
+struct sb_run {
+    uint16_t length;
+    uint8_t attrs;
+};
+
+// Stored line: header, run_count runs, then the text of length cells as
+// text_bytes of UTF-8
+struct sb_line {
+    uint16_t length;
+    uint16_t run_count;
+    uint16_t text_bytes;
+    unsigned char data[];
+};
+
+// Ring of line pointers, oldest at head
+static struct sb_line **lines = NULL;
+static int capacity = 0;
+static int head = 0;
+static int count = 0;
+static size_t bytes_used = 0;
+static size_t max_bytes = 0;
+
+static size_t line_size(const struct sb_line *line) {
+    return sizeof(*line) + line->run_count * sizeof(struct sb_run) + line->text_bytes;
+}
+
+static int is_blank(const struct term_cell *cell) {
+    return cell->ch == ' ' && cell->attrs == 0;
+}
+
+static int same_style(const struct term_cell *a, const struct sb_run *run) {
+    return a->attrs == run->attrs;
+}
+
+static void drop_oldest(void) {
+    struct sb_line *line = lines[head];
+    bytes_used -= line_size(line);
+    free(line);
+    lines[head] = NULL;
+    head = (head + 1) % capacity;
+    count--;
+}
+
+// Double the line table, unwrapping the ring so head starts at 0
+static int grow(void) {
+    int new_capacity = capacity ? capacity * 2 : 64;
+    struct sb_line **table = malloc(new_capacity * sizeof(*table));
+    if (!table) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        table[i] = lines[(head + i) % capacity];
+    }
+    bytes_used += (new_capacity - capacity) * sizeof(*table);
+    free(lines);
+    lines = table;
+    capacity = new_capacity;
+    head = 0;
+    return 0;
+}
+
+int scrollback_init(size_t limit) {
+    scrollback_destroy();
+    max_bytes = limit;
+    return 0;
+}
+
+void scrollback_destroy(void) {
+    while (count > 0) {
+        drop_oldest();
+    }
+    free(lines);
+    lines = NULL;
+    capacity = 0;
+    head = 0;
+    bytes_used = 0;
+}
+
+void scrollback_push(const struct term_cell *row, int cols) {
+    if (max_bytes == 0) return;
+
+    int length = cols;
+    while (length > 0 && is_blank(&row[length - 1])) {
+        length--;
+    }
+
+    int run_count = 0;
+    int text_bytes = 0;
+    struct sb_run runs[length ? length : 1];
+    unsigned char text[length * 4 + 1];
+    for (int c = 0; c < length; c++) {
+        text_bytes += utf8_encode(row[c].ch, text + text_bytes);
+        if (run_count > 0 && same_style(&row[c], &runs[run_count - 1])) {
+            runs[run_count - 1].length++;
+            continue;
+        }
+        runs[run_count].length = 1;
+        runs[run_count].attrs = row[c].attrs;
+        run_count++;
+    }
+
+    size_t size = sizeof(struct sb_line) + run_count * sizeof(struct sb_run) + text_bytes;
+    if (size > max_bytes) return;
+
+    while (count > 0 && bytes_used + size > max_bytes) {
+        drop_oldest();
+    }
+    if (count == capacity) {
+        // Growing the table counts against the cap too; reuse the oldest
+        // slot instead when it would not fit
+        size_t extra = (capacity ? capacity : 64) * sizeof(*lines);
+        if (count > 0 && bytes_used + extra + size > max_bytes) {
+            drop_oldest();
+        } else if (grow() != 0) {
+            return;
+        }
+    }
+
+    struct sb_line *line = malloc(size);
+    if (!line) return;
+    line->length = length;
+    line->run_count = run_count;
+    line->text_bytes = text_bytes;
+    memcpy(line->data, runs, run_count * sizeof(struct sb_run));
+    memcpy(line->data + run_count * sizeof(struct sb_run), text, text_bytes);
+
+    lines[(head + count) % capacity] = line;
+    count++;
+    bytes_used += size;
+}
+
+int scrollback_count(void) {
+    return count;
+}
+
+void scrollback_get(int index, struct term_cell *row, int cols) {
+    int c = 0;
+
+    if (index >= 0 && index < count) {
+        const struct sb_line *line = lines[(head + count - 1 - index) % capacity];
+        const unsigned char *text = line->data + line->run_count * sizeof(struct sb_run);
+
+        for (int r = 0; r < line->run_count && c < cols; r++) {
+            struct sb_run run;
+            memcpy(&run, line->data + r * sizeof(run), sizeof(run));
+            for (int i = 0; i < run.length && c < cols; i++, c++) {
+                text += utf8_decode(text, &row[c].ch);
+                row[c].attrs = run.attrs;
+            }
+        }
+    }
+
+    for (; c < cols; c++) {
+        row[c].ch = ' ';
+        row[c].attrs = 0;
+    }
+}
+
+size_t scrollback_memory_used(void) {
+    return bytes_used;
+}
+
+size_t scrollback_memory_limit(void) {
+    return max_bytes;
+}
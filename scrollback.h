@@ -0,0 +1,26 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+#include "term_cell.h"
+
+// Lines that scrolled off the top of the screen, stored compactly (trailing
+// blanks trimmed, attributes run-length encoded) under a hard memory cap.
+// The oldest lines are dropped once the cap is reached.
+int scrollback_init(size_t max_bytes);
+void scrollback_destroy(void);
+
+// Save one screen row of cols cells as the newest history line
+void scrollback_push(const struct term_cell *row, int cols);
+
+// Number of stored lines
+int scrollback_count(void);
+
+// Expand history line index (0 = newest) into cols cells, blank padded
+void scrollback_get(int index, struct term_cell *row, int cols);
+
+// Bytes currently held, including the line table
+size_t scrollback_memory_used(void);
+size_t scrollback_memory_limit(void);
+
+#endif // SCROLLBACK_H
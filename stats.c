@@ -0,0 +1,157 @@
+#define _GNU_SOURCE  // accept4
+#include "stats.h"
+#include "display.h"
+#include "hwconfig.h"
+#include "latency.h"
+#include "log.h"
+#include "scheduler.h"
+#include "tsm_term.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define STATS_REPORT_SIZE 4096
+
+static int listen_fd = -1;
+static char socket_path[108];
+static time_t started;
+
+// Report being built for the current client
+static char report[STATS_REPORT_SIZE];
+static size_t report_len;
+
+static void add(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(report + report_len, sizeof(report) - report_len, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        report_len += n;
+        if (report_len >= sizeof(report)) report_len = sizeof(report) - 1;
+    }
+}
+
+static void build_report(void) {
+    static const char *escape_names[TSM_ESCAPE_TYPE_COUNT] = {"csi", "osc", "other"};
+    static const char *mode_names[DISPLAY_MODE_QUALITY + 1] = {
+        [DISPLAY_MODE_FAST] = "fast",
+        [DISPLAY_MODE_PARTIAL] = "partial",
+        [DISPLAY_MODE_QUALITY] = "full"
+    };
+    static const char *reason_names[SCHED_REASON_COUNT] = {
+        "wait", "interactive", "settled", "deadline"
+    };
+
+    struct tsm_term_stats term;
+    struct display_stats display;
+    struct scheduler_stats sched;
+    struct latency_stats latency;
+    tsm_term_get_stats(&term);
+    display_get_stats(&display);
+    scheduler_get_stats(&sched);
+    latency_get_stats(&latency);
+
+    report_len = 0;
+    add("epd_uptime_seconds %ld\n", (long)(time(NULL) - started));
+
+    // Terminal
+    add("epd_bytes_parsed_total %llu\n", term.bytes_parsed);
+    for (int i = 0; i < TSM_ESCAPE_TYPE_COUNT; i++) {
+        add("epd_escape_sequences_total{type=\"%s\"} %lu\n", escape_names[i], term.escapes[i]);
+    }
+    add("epd_frames_rendered_total %lu\n", term.frames);
+    add("epd_refreshes_skipped_total %lu\n", term.skipped_redraws);
+    add("epd_input_pending_bytes %zu\n", tsm_term_input_pending());
+
+    // Panel
+    for (int m = DISPLAY_MODE_FAST; m <= DISPLAY_MODE_QUALITY; m++) {
+        add("epd_refreshes_total{mode=\"%s\"} %lu\n", mode_names[m], display.refreshes[m]);
+    }
+    for (int m = DISPLAY_MODE_FAST; m <= DISPLAY_MODE_QUALITY; m++) {
+        add("epd_refresh_cost_ms{mode=\"%s\"} %lu\n", mode_names[m],
+            display_refresh_cost((enum display_mode)m));
+    }
+    add("epd_busy_ms_total %llu\n", display.busy_ms);
+    add("epd_spi_bytes_total %llu\n", (unsigned long long)DEV_SPI_Bytes());
+    add("epd_panel_wear_full_refreshes %llu.%03llu\n",
+        display.wear_milli / 1000, display.wear_milli % 1000);
+
+    // Scheduler
+    for (int r = 0; r < SCHED_REASON_COUNT; r++) {
+        add("epd_scheduler_decisions_total{reason=\"%s\"} %lu\n", reason_names[r],
+            sched.decisions[r]);
+    }
+    add("epd_partials_since_clean %lu\n", sched.partial_since_clean);
+    add("epd_output_rate_bytes_per_second %lu\n", sched.output_rate);
+
+    // Keypress to ink
+    add("epd_keypress_to_ink_ms{quantile=\"0.5\"} %lu\n", latency.p50_ms);
+    add("epd_keypress_to_ink_ms{quantile=\"0.9\"} %lu\n", latency.p90_ms);
+    add("epd_keypress_to_ink_ms{quantile=\"0.99\"} %lu\n", latency.p99_ms);
+    add("epd_keypress_to_ink_max_ms %lu\n", latency.max_ms);
+    add("epd_keypress_to_ink_count %lu\n", latency.count);
+    add("epd_keypresses_lost_total %lu\n", latency.lost);
+}
+
+int stats_init(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_warn("stats_init: socket path too long: %s", path);
+        return -1;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        log_warn("stats_init: socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);  // left behind by an earlier run
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 4) < 0) {
+        log_warn("stats_init: cannot listen on %s: %s", path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    strcpy(socket_path, path);
+    started = time(NULL);
+    log_info("Statistics on %s", path);
+    return 0;
+}
+
+void stats_close(void) {
+    if (listen_fd < 0) return;
+    close(listen_fd);
+    unlink(socket_path);
+    listen_fd = -1;
+}
+
+int stats_fd(void) {
+    return listen_fd;
+}
+
+void stats_serve(void) {
+    while (listen_fd >= 0) {
+        int client = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN: everyone was served
+        }
+
+        // A few KB always fit in a fresh socket's buffer; a client that
+        // went away meanwhile just misses it
+        build_report();
+        send(client, report, report_len, MSG_NOSIGNAL);
+        close(client);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Local statistics server. Every connection to the Unix socket gets the
+// current counters and gauges as text and is closed, one metric per line
+// in the Prometheus exposition format:
+//   epd_refreshes_total{mode="partial"} 42
+// The numbers are collected from the modules' own counters when a client
+// connects, so nothing is added to the hot paths.
+
+#define STATS_SOCKET_PATH "/tmp/epd_term.sock"  // overridden by $EPD_STATS_SOCKET
+
+// Listen on path. Returns 0 or -1; the terminal runs fine without it.
+int stats_init(const char *path);
+void stats_close(void);
+
+// Listening socket to poll() for POLLIN (-1 when not serving)
+int stats_fd(void);
+
+// Answer the clients waiting to be accepted
+void stats_serve(void);
+
+#endif // STATS_H
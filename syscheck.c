@@ -0,0 +1,459 @@
+#define _GNU_SOURCE  // mkdtemp, dprintf, __WALL
+#include "syscheck.h"
+#include "display.h"
+#include "hwconfig.h"
+#include <sys/ptrace.h>
+#include <linux/ptrace.h>
+#include <linux/input.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SESSION_START_MS 500   // idle time before typing starts
+#define KEY_INTERVAL_MS 150    // typing speed: every echo gets its own refresh
+#define SESSION_TIMEOUT_S 60
+#define SIM_REFRESH_MS "50"    // keeps the sessions short
+#define BUDGET_HEADROOM 1.5    // recorded budgets leave room for timing noise
+#define BUDGET_FLOOR 0.2       // per unit: a few stray calls in a session pass
+#define REPORT_FD_ENV "EPD_SYSCHECK_FD"
+
+enum unit { PER_KEY, PER_REFRESH };
+
+struct session {
+    const char *name;
+    const char *script;       // shell script run as $SHELL (NULL: /bin/sh -i)
+    const char *keys;         // typed once the terminal is up, '\n' is Enter
+    unsigned long settle_ms;  // kept running after the last key
+    enum unit unit;
+};
+
+static const struct session sessions[] = {
+    // Typing at a prompt: echo, prediction and a partial refresh per key
+    { "typing", NULL, "echo hello world\n", 1000, PER_KEY },
+    // Output arriving in small bursts, each shown with its own refresh
+    { "output",
+      "i=0\n"
+      "while [ $i -lt 20 ]; do echo \"line $i\"; i=$((i+1)); sleep 0.3; done\n"
+      "exec cat\n",
+      "", 7000, PER_REFRESH },
+};
+#define SESSION_COUNT (int)(sizeof(sessions) / sizeof(sessions[0]))
+
+// Syscalls are counted by type; related calls share one
+enum syscall_type {
+    SC_READ,
+    SC_WRITE,
+    SC_POLL,
+    SC_EPOLL_WAIT,
+    SC_IOCTL,
+    SC_BUS,             // the simulated panel's bus transactions
+    SC_SLEEP,
+    SC_TIMERFD_SETTIME,
+    SC_CLOCK_GETTIME,
+    SC_OTHER,
+    SC_TYPE_COUNT
+};
+
+static const char *type_names[SC_TYPE_COUNT] = {
+    "read", "write", "poll", "epoll_wait", "ioctl", "bus", "sleep",
+    "timerfd_settime", "clock_gettime", "other"
+};
+
+static const struct {
+    long nr;
+    enum syscall_type type;
+} syscall_types[] = {
+    { SYS_read, SC_READ },
+    { SYS_write, SC_WRITE },
+    { SYS_writev, SC_WRITE },
+#ifdef SYS_poll
+    { SYS_poll, SC_POLL },
+#endif
+    { SYS_ppoll, SC_POLL },
+#ifdef SYS_epoll_wait
+    { SYS_epoll_wait, SC_EPOLL_WAIT },
+#endif
+    { SYS_epoll_pwait, SC_EPOLL_WAIT },
+    { SYS_ioctl, SC_IOCTL },
+#ifdef SYS_nanosleep
+    { SYS_nanosleep, SC_SLEEP },
+#endif
+    { SYS_clock_nanosleep, SC_SLEEP },
+    { SYS_timerfd_settime, SC_TIMERFD_SETTIME },
+    { SYS_clock_gettime, SC_CLOCK_GETTIME },
+};
+
+// Most of each syscall per unit of work. Refresh with
+// epd_test --syscall-check record after deliberate changes; types not
+// listed for a session are reported but not budgeted.
+static const struct {
+    const char *session;
+    const char *syscall;
+    double max;
+} budgets[] = {
+    { "typing", "read", 21.2 },
+    { "typing", "write", 1.6 },
+    { "typing", "poll", 6.4 },
+    { "typing", "epoll_wait", 3.2 },
+    { "typing", "ioctl", 0.2 },
+    { "typing", "bus", 103.5 },
+    { "typing", "sleep", 3.4 },
+    { "typing", "timerfd_settime", 9.1 },
+    { "typing", "clock_gettime", 0.2 },
+    { "typing", "other", 0.2 },
+    { "output", "read", 8.2 },
+    { "output", "write", 0.2 },
+    { "output", "poll", 4.8 },
+    { "output", "epoll_wait", 0.2 },
+    { "output", "ioctl", 0.2 },
+    { "output", "bus", 52.3 },
+    { "output", "sleep", 2.0 },
+    { "output", "timerfd_settime", 6.2 },
+    { "output", "clock_gettime", 0.2 },
+    { "output", "other", 0.2 },
+};
+
+static volatile sig_atomic_t timed_out = 0;
+
+static void on_alarm(int sig) {
+    (void)sig;
+    timed_out = 1;
+}
+
+static void sleep_ms(unsigned long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+static uint16_t key_code(char ch) {
+    static const uint16_t letters[26] = {
+        KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I,
+        KEY_J, KEY_K, KEY_L, KEY_M, KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R,
+        KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+    };
+    if (ch >= 'a' && ch <= 'z') return letters[ch - 'a'];
+    if (ch >= '1' && ch <= '9') return KEY_1 + (ch - '1');
+    if (ch == '0') return KEY_0;
+    if (ch == ' ') return KEY_SPACE;
+    if (ch == '\n') return KEY_ENTER;
+    return 0;
+}
+
+static int count_keys(const char *keys) {
+    int n = 0;
+    for (const char *p = keys; *p; p++) {
+        if (key_code(*p)) n++;
+    }
+    return n;
+}
+
+static void send_key(int fd, uint16_t code, int value) {
+    struct input_event ev[2];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = EV_KEY;
+    ev[0].code = code;
+    ev[0].value = value;
+    ev[1].type = EV_SYN;
+    ev[1].code = SYN_REPORT;
+    if (write(fd, ev, sizeof(ev)) < 0) {
+        _exit(1);
+    }
+}
+
+// The typing process: presses the session's keys into the pipe the
+// terminal reads as a keyboard, then waits for the last refresh
+static void type_keys(const char *fifo, const struct session *s) {
+    int fd = open(fifo, O_WRONLY);
+    if (fd < 0) {
+        _exit(1);
+    }
+    sleep_ms(SESSION_START_MS);
+    for (const char *p = s->keys; *p; p++) {
+        uint16_t code = key_code(*p);
+        if (!code) continue;
+        send_key(fd, code, 1);
+        send_key(fd, code, 0);
+        sleep_ms(KEY_INTERVAL_MS);
+    }
+    sleep_ms(s->settle_ms);
+    _exit(0);
+}
+
+void syscheck_report(void) {
+    const char *fd = getenv(REPORT_FD_ENV);
+    if (!fd) return;
+
+    struct display_stats stats;
+    display_get_stats(&stats);
+    unsigned long refreshes = 0;
+    for (int m = 0; m <= DISPLAY_MODE_QUALITY; m++) {
+        refreshes += stats.refreshes[m];
+    }
+    dprintf(atoi(fd), "refreshes %lu\n", refreshes);
+}
+
+// This binary as the terminal, on the simulated panel, traced. It reports
+// on report_fd when its main loop starts and when it ends.
+static pid_t start_terminal(const char *fifo, const char *shell, int report_fd) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    char fd[16];
+    snprintf(fd, sizeof(fd), "%d", report_fd);
+    setenv(REPORT_FD_ENV, fd, 1);
+    setenv("EPD_KEYBOARD", fifo, 1);
+    setenv("SHELL", shell, 1);
+    setenv("EPD_SIM_REFRESH_MS", SIM_REFRESH_MS, 1);
+    setenv("EPD_STATS_SOCKET", "", 1);
+    unsetenv("EPD_TRACE_FILE");
+
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    execl("/proc/self/exe", "epd_test", (char *)NULL);
+    _exit(127);
+}
+
+// Next syscheck_report line from the terminal: its refresh count, or -1
+// if none has arrived
+static long read_report(int fd) {
+    char line[64];
+    size_t len = 0;
+    while (len < sizeof(line) - 1 && read(fd, line + len, 1) == 1) {
+        if (line[len] == '\n') {
+            line[len] = '\0';
+            unsigned long refreshes;
+            return sscanf(line, "refreshes %lu", &refreshes) == 1 ? (long)refreshes : -1;
+        }
+        len++;
+    }
+    return -1;
+}
+
+static enum syscall_type syscall_type(unsigned long long nr) {
+    for (size_t i = 0; i < sizeof(syscall_types) / sizeof(syscall_types[0]); i++) {
+        if ((unsigned long long)syscall_types[i].nr == nr) {
+            return syscall_types[i].type;
+        }
+    }
+    return SC_OTHER;
+}
+
+static void count_syscall(pid_t pid, unsigned long counts[]) {
+    struct ptrace_syscall_info info;
+    if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0 ||
+        info.op != PTRACE_SYSCALL_INFO_ENTRY) {
+        return;
+    }
+    if (info.entry.nr == SYS_ioctl && info.entry.args[1] == SIM_BUS_IOCTL) {
+        counts[SC_BUS]++;
+    } else {
+        counts[syscall_type(info.entry.nr)]++;
+    }
+}
+
+// Run one session and count the terminal's syscalls from the start of its
+// main loop until the typing process is done. Returns the units of work
+// done (keys or refreshes), -1 on failure.
+static long run_session(const struct session *s, unsigned long counts[]) {
+    char dir[] = "/tmp/epd-syscheck-XXXXXX";
+    char fifo[64], shell[64];
+    long units = -1;
+
+    if (!mkdtemp(dir)) {
+        perror("syscheck: mkdtemp");
+        return -1;
+    }
+    snprintf(fifo, sizeof(fifo), "%s/keys", dir);
+    snprintf(shell, sizeof(shell), "%s/shell", dir);
+    if (mkfifo(fifo, 0600) < 0) {
+        perror("syscheck: mkfifo");
+        rmdir(dir);
+        return -1;
+    }
+    if (s->script) {
+        FILE *f = fopen(shell, "w");
+        if (!f) {
+            perror("syscheck: shell script");
+            goto out;
+        }
+        fprintf(f, "#!/bin/sh\n%s", s->script);
+        fclose(f);
+        chmod(shell, 0700);
+    } else {
+        snprintf(shell, sizeof(shell), "/bin/sh");
+    }
+
+    int report[2];
+    if (pipe(report) < 0) {
+        perror("syscheck: pipe");
+        goto out;
+    }
+    fcntl(report[0], F_SETFL, O_NONBLOCK);
+    pid_t term = start_terminal(fifo, shell, report[1]);
+    close(report[1]);
+    if (term < 0) {
+        perror("syscheck: fork");
+        close(report[0]);
+        goto out;
+    }
+
+    // Stopped at the exec: trace syscalls from here, not the shell it forks
+    int status;
+    if (waitpid(term, &status, 0) != term || !WIFSTOPPED(status)) {
+        fprintf(stderr, "syscheck: terminal did not start\n");
+        close(report[0]);
+        goto out;
+    }
+    ptrace(PTRACE_SETOPTIONS, term, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, term, NULL, NULL);
+
+    long refreshes_at_start = -1;
+    pid_t typist = -1;
+    int counting = 0, typed = 0, exited = 0;
+    memset(counts, 0, SC_TYPE_COUNT * sizeof(counts[0]));
+    timed_out = 0;
+    alarm(SESSION_TIMEOUT_S);
+
+    while (!exited) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR && timed_out) {
+                fprintf(stderr, "syscheck: %s timed out\n", s->name);
+                kill(term, SIGKILL);
+                typed = 0;
+                continue;
+            }
+            if (errno == ECHILD) break;
+            continue;
+        }
+        if (pid == typist) {
+            // Done typing: stop counting and let the terminal shut down
+            counting = 0;
+            typist = -1;
+            kill(term, SIGTERM);
+            continue;
+        }
+        if (pid != term) continue;
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            exited = 1;
+            continue;
+        }
+
+        int sig = WSTOPSIG(status);
+        if (sig == (SIGTRAP | 0x80)) {
+            if (counting) count_syscall(term, counts);
+            sig = 0;
+        } else if (sig == SIGTRAP) {
+            sig = 0;
+        }
+        if (!typed && (refreshes_at_start = read_report(report[0])) >= 0) {
+            typed = counting = 1;
+            typist = fork();
+            if (typist == 0) {
+                type_keys(fifo, s);
+            }
+        }
+        ptrace(PTRACE_SYSCALL, term, NULL, sig);
+    }
+    alarm(0);
+
+    if (typist > 0) {
+        kill(typist, SIGKILL);
+        waitpid(typist, NULL, 0);
+    }
+    // Refreshes done meanwhile, from the terminal's own count at exit
+    long refreshes_at_end = read_report(report[0]);
+    close(report[0]);
+    if (!typed || timed_out || refreshes_at_end < 0) {
+        fprintf(stderr, "syscheck: %s did not run to the end\n", s->name);
+    } else {
+        units = s->unit == PER_KEY ? count_keys(s->keys)
+                                   : refreshes_at_end - refreshes_at_start;
+    }
+
+out:
+    unlink(fifo);
+    if (s->script) unlink(shell);
+    rmdir(dir);
+    return units;
+}
+
+// Budget for a syscall type in a session, -1 if it has none
+static double budget_for(const struct session *s, enum syscall_type type) {
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        if (strcmp(budgets[i].session, s->name) == 0 &&
+            strcmp(budgets[i].syscall, type_names[type]) == 0) {
+            return budgets[i].max;
+        }
+    }
+    return -1;
+}
+
+int syscheck_run(int argc, char *argv[]) {
+    int record = argc > 0 && strcmp(argv[0], "record") == 0;
+    int failed = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_alarm;  // no SA_RESTART: interrupts waitpid
+    sigaction(SIGALRM, &sa, NULL);
+
+    for (int i = 0; i < SESSION_COUNT; i++) {
+        const struct session *s = &sessions[i];
+        const char *unit = s->unit == PER_KEY ? "key" : "refresh";
+        const char *units_name = s->unit == PER_KEY ? "keys" : "refreshes";
+        unsigned long counts[SC_TYPE_COUNT];
+
+        long units = run_session(s, counts);
+        if (units <= 0) {
+            fprintf(stderr, "syscheck: %s: no %s to measure\n", s->name, units_name);
+            failed = 1;
+            continue;
+        }
+
+        printf("%s: %ld %s\n", s->name, units, units_name);
+        for (int t = 0; t < SC_TYPE_COUNT; t++) {
+            double per_unit = (double)counts[t] / units;
+            double budget = budget_for(s, t);
+            if (record) {
+                // Every type gets a budget, the ones that didn't occur too
+                double max = per_unit * BUDGET_HEADROOM;
+                printf("    { \"%s\", \"%s\", %.1f },\n", s->name, type_names[t],
+                       (max > BUDGET_FLOOR ? max : BUDGET_FLOOR) + 0.05);
+                continue;
+            }
+            if (!counts[t] && budget < 0) continue;
+            if (budget < 0) {
+                printf("  %-16s %9.2f per %s (not budgeted)\n", type_names[t], per_unit, unit);
+                continue;
+            }
+
+            int over = per_unit > budget;
+            printf("  %-16s %9.2f per %s (budget %.2f)%s\n", type_names[t], per_unit,
+                   unit, budget, over ? "  OVER BUDGET" : "");
+            failed |= over;
+        }
+    }
+
+    if (!record) {
+        printf(failed ? "Syscall budget exceeded\n" : "Syscall budgets met\n");
+    }
+    return failed ? 1 : 0;
+}
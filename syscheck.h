@@ -0,0 +1,24 @@
+#ifndef SYSCHECK_H
+#define SYSCHECK_H
+
+// Syscall budget check, built into the simulated panel build (make SIM=1):
+//
+//   epd_test --syscall-check          run the scripted sessions, exit 1 if
+//                                     any syscall count is over budget
+//   epd_test --syscall-check record   print the measured figures as budget
+//                                     table rows for syscheck.c
+//
+// Each session starts this same binary on the simulated panel under
+// ptrace, types into it through an $EPD_KEYBOARD pipe and counts the
+// terminal's syscalls by type while it runs. The counts are divided by
+// the keys typed or the refreshes done, and compared against the budgets
+// recorded in syscheck.c. The shell and the typing process aren't counted.
+// make check builds the simulator and runs this.
+int syscheck_run(int argc, char *argv[]);
+
+// In a terminal started by the check: report the refreshes done so far.
+// Called when the main loop starts (which also starts the counting) and
+// when it ends; does nothing otherwise.
+void syscheck_report(void);
+
+#endif // SYSCHECK_H
@@ -0,0 +1,26 @@
+#ifndef TERM_CELL_H
+#define TERM_CELL_H
+
+#include <stdint.h>
+
+// Packed attribute bits, set from SGR. Colors are folded into these by the
+// terminal's color policy, since the panel only has black and white.
+#define ATTR_BOLD 0x01
+#define ATTR_UNDERLINE 0x02
+#define ATTR_REVERSE 0x04
+#define ATTR_DIM 0x08
+#define ATTR_STRIKE 0x10
+#define ATTR_STYLE_MASK 0x1F
+
+// Double-width characters occupy a leader cell holding the code point and a
+// continuation cell to its right that is drawn together with it
+#define ATTR_WIDE 0x40
+#define ATTR_WIDE_CONT 0x80
+
+// One character cell of the terminal grid
+struct term_cell {
+    uint32_t ch; // Unicode code point
+    uint8_t attrs;
+};
+
+#endif // TERM_CELL_H
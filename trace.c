@@ -0,0 +1,166 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define TRACE_MASK (TRACE_RING_SIZE - 1)
+
+struct trace_record {
+    uint64_t seq;      // slot number + 1 once written, 0 while empty
+    uint64_t time_us;  // CLOCK_MONOTONIC
+    uint32_t event;
+    uint32_t a;
+    uint32_t b;
+};
+
+// How each event reads in a dump
+struct trace_format {
+    const char *name;
+    const char *a;
+    const char *b;
+    int a_is_char;  // first argument is a CSI final byte
+};
+
+static const struct trace_format formats[TRACE_EVENT_COUNT] = {
+    [TRACE_PTY_READ]        = {"pty_read", "bytes", "asked", 0},
+    [TRACE_KEY]             = {"key", "code", "mods", 0},
+    [TRACE_INPUT_DROP]      = {"input_drop", "bytes", "queued", 0},
+    [TRACE_CSI]             = {"csi", "final", "len", 1},
+    [TRACE_CSI_UNHANDLED]   = {"csi_unhandled", "final", "len", 1},
+    [TRACE_MODE_UNHANDLED]  = {"mode_unhandled", "mode", "set", 0},
+    [TRACE_PREDICT_TIMEOUT] = {"predict_timeout", "dropped", "-", 0},
+    [TRACE_RENDER]          = {"render", "cells", "-", 0},
+    [TRACE_REDRAW]          = {"redraw", "y_start", "y_end", 0},
+    [TRACE_REFRESH]         = {"refresh", "mode", "cause", 0},
+    [TRACE_REFRESH_DONE]    = {"refresh_done", "mode", "ms", 0},
+};
+
+static struct trace_record ring[TRACE_RING_SIZE];
+static uint64_t next_slot = 0;
+static int dump_fd = STDERR_FILENO;
+
+void trace(enum trace_event event, uint32_t a, uint32_t b) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);  // vDSO, no syscall
+
+    uint64_t slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED);
+    struct trace_record *rec = &ring[slot & TRACE_MASK];
+
+    // Mark the slot as being rewritten, fill it, then publish it
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rec->time_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    rec->event = event;
+    rec->a = a;
+    rec->b = b;
+    __atomic_store_n(&rec->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+// Formatting without stdio, usable from a signal handler
+static char *put_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+static char *put_uint(char *p, uint64_t v, int min_digits) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n < min_digits) digits[n++] = '0';
+    while (n) *p++ = digits[--n];
+    return p;
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(dump_fd, buf, len);
+        if (n <= 0) return;
+        buf += n;
+        len -= n;
+    }
+}
+
+// One event as "<seconds>.<micros> <name> <a-name>=<a> <b-name>=<b>"
+static size_t format_record(char *line, const struct trace_record *rec) {
+    char *p = line;
+    const struct trace_format *f = &formats[rec->event];
+
+    p = put_uint(p, rec->time_us / 1000000, 1);
+    *p++ = '.';
+    p = put_uint(p, rec->time_us % 1000000, 6);
+    *p++ = ' ';
+    p = put_str(p, f->name);
+    *p++ = ' ';
+    p = put_str(p, f->a);
+    *p++ = '=';
+    if (f->a_is_char && rec->a >= 0x20 && rec->a < 0x7f) {
+        *p++ = (char)rec->a;
+    } else {
+        p = put_uint(p, rec->a, 1);
+    }
+    *p++ = ' ';
+    p = put_str(p, f->b);
+    *p++ = '=';
+    p = put_uint(p, rec->b, 1);
+    *p++ = '\n';
+    return p - line;
+}
+
+void trace_dump(void) {
+    uint64_t end = __atomic_load_n(&next_slot, __ATOMIC_ACQUIRE);
+    uint64_t start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    char line[128];
+
+    write_all("--- trace ---\n", 14);
+    for (uint64_t slot = start; slot < end; slot++) {
+        const struct trace_record *src = &ring[slot & TRACE_MASK];
+        struct trace_record rec;
+
+        // Skip slots still being written or already reused by a newer event
+        if (__atomic_load_n(&src->seq, __ATOMIC_ACQUIRE) != slot + 1) continue;
+        rec = *src;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&src->seq, __ATOMIC_RELAXED) != slot + 1) continue;
+        if (rec.event >= TRACE_EVENT_COUNT) continue;
+
+        write_all(line, format_record(line, &rec));
+    }
+    write_all("--- end of trace ---\n", 21);
+}
+
+// Dump what led up to the crash, then die of the same signal
+static void crash_handler(int sig) {
+    char line[64];
+    char *p = put_str(line, "Crashed with signal ");
+    p = put_uint(p, sig, 1);
+    *p++ = '\n';
+    write_all(line, p - line);
+    trace_dump();
+    raise(sig);  // the handler was reset, so this is the default action
+}
+
+void trace_init(void) {
+    const char *path = getenv("EPD_TRACE_FILE");
+    if (path) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            dump_fd = fd;
+        }
+    }
+
+    static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+        sigaction(crash_signals[i], &sa, NULL);
+    }
+}
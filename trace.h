@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// In-memory trace of what the terminal did recently: fixed-size binary
+// records in a ring that keeps the last TRACE_RING_SIZE events. Recording
+// takes no lock and makes no syscall, so it stays on in production; the
+// ring is written out as text on request (SIGUSR1) and when the process
+// crashes.
+
+enum trace_event {
+    TRACE_PTY_READ,         // bytes read, read size asked for
+    TRACE_KEY,              // evdev keycode, modifiers
+    TRACE_INPUT_DROP,       // bytes, input queue length
+    TRACE_CSI,              // final byte, sequence length
+    TRACE_CSI_UNHANDLED,    // final byte, sequence length
+    TRACE_MODE_UNHANDLED,   // private mode number, set or reset
+    TRACE_PREDICT_TIMEOUT,  // predictions dropped, 0
+    TRACE_RENDER,           // cells rendered, 0
+    TRACE_REDRAW,           // first and last pixel row pushed
+    TRACE_REFRESH,          // display mode, trace_refresh_cause
+    TRACE_REFRESH_DONE,     // display mode, milliseconds it took
+    TRACE_EVENT_COUNT
+};
+
+// Why the main loop refreshed, recorded with TRACE_REFRESH
+enum trace_refresh_cause {
+    TRACE_CAUSE_SCHEDULER,
+    TRACE_CAUSE_APPLICATION,
+    TRACE_CAUSE_SYNC_TIMEOUT
+};
+
+#define TRACE_RING_SIZE 4096  // events kept, a power of two
+
+// Dumps go to $EPD_TRACE_FILE (appended) when set, stderr otherwise.
+// Also installs the handlers that dump the ring on a crash.
+void trace_init(void);
+
+// Record an event with two event-specific arguments
+void trace(enum trace_event event, uint32_t a, uint32_t b);
+
+// Write the ring, oldest event first, as one text line per event.
+// Async-signal-safe.
+void trace_dump(void);
+
+#endif // TRACE_H
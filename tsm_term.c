@@ -1,42 +1,159 @@
 #include "tsm_term.h"
+#include "char_width.h"
+#include "display.h"
 #include "EPD_7in5_V2.h"
 #include "font8x16.h"
+#include "font_table.h"
+#include "glyph_cache.h"
+#include "keyboard.h"
 #include "keymap.h"
+#include "latency.h"
+#include "log.h"
+#include "pty.h"
+#include "scrollback.h"
+#include "term_cell.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <errno.h>
 #include <linux/input-event-codes.h>
 
-#define CELL_WIDTH 8
-#define CELL_HEIGHT 16
-#define COLOR_WHITE 0
-#define COLOR_BLACK 1
+#define FB_STRIDE (EPD_7IN5_V2_WIDTH / 8)
+#define SCROLLBACK_MAX_BYTES (256 * 1024)
+// Font for glyphs outside the compiled tables, overridden by $EPD_FONT
+#define FALLBACK_FONT_PATH "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
 
-// Output buffering - much larger buffer
-#define OUTPUT_BUFFER_SIZE 8192
+// Private OSC for refresh control: ESC ] 7750 ; <command> BEL
+//   full                        clean full refresh right now
+//   mode=auto|fast|partial|quality  how later frames are pushed
+//   pause / resume              hold or release refreshes
+//   colors=mono|gray            how SGR colors map onto the panel
+#define EPD_OSC_NUMBER 7750
+
+// Identification reported to XTVERSION queries
+#define TERM_NAME "epd-term"
+#define TERM_VERSION "1.0"
+
+// Cell geometry follows the selected font table. Widths are whole bytes so
+// every glyph row is a plain store into the framebuffer.
+static const struct font_table *font = NULL;
+static int cell_width = 8;
+static int cell_height = 16;
+static int cell_bytes = 1;
+
+// Output buffering. PTY output is queued here and parsed in bounded slices
+// by tsm_term_parse; bytes before output_parse_pos are already parsed.
+#define OUTPUT_BUFFER_SIZE 32768  // room for the largest PTY read
+#define PARSE_SLICE 512   // bytes parsed between time budget checks
 static char output_buffer[OUTPUT_BUFFER_SIZE];
 static size_t output_buffer_pos = 0;
+static size_t output_parse_pos = 0;
 static int output_buffer_dirty = 0;
 
+// Input for the PTY (key presses, query replies). Appended as it comes and
+// written with one write() per loop turn by tsm_term_flush_input; whatever
+// the PTY doesn't take stays queued for the next turn.
+#define INPUT_QUEUE_SIZE 4096
+static char input_queue[INPUT_QUEUE_SIZE];
+static size_t input_queue_len = 0;
+
 // Terminal state
-static int term_rows = 24;
-static int term_cols = 80;
+static int term_rows = 0;
+static int term_cols = 0;
 static int cursor_row = 0;
 static int cursor_col = 0;
 static uint8_t *framebuffer = NULL;
 static size_t buffer_size = 0;
 static int pty_fd = -1;
 static int damage_pending = 0;
+static int panel_damaged = 0; // pixels outside the grid changed (resize)
+
+// Grid sized from the panel at runtime: one block of cells plus a table of
+// row pointers into it, so screen_buffer[r][c] indexes like a 2D array
+static struct term_cell *cell_storage = NULL;
+static struct term_cell **screen_buffer = NULL;
+
+// The grid that is not being shown: the alternate screen while the primary
+// is active and vice versa. Switching screens swaps these with the two
+// above, so nothing is copied.
+static struct term_cell *alt_storage = NULL;
+static struct term_cell **alt_buffer = NULL;
+static int alt_screen_active = 0;
+static int saved_cursor_row = 0;
+static int saved_cursor_col = 0;
+
+// What cursor and keypad keys send (KEYMAP_APP_* set by DECCKM and DECKPAM)
+static int key_modes = 0;
+
+// Synchronized update (DEC mode 2026): while open the application is in the
+// middle of a frame and the panel should not be refreshed
+static int sync_update_active = 0;
+static int sync_frame_complete = 0;
 
-// Screen buffer - stores characters and attributes
-static struct {
-    char ch;
-    uint8_t fg_color;
-    uint8_t bg_color;
-    uint8_t attrs; // bold, underline, etc.
-} screen_buffer[30][100]; // Max size
+// Local echo prediction: printable keys are drawn at the predicted cursor
+// position right away and dropped once the shell's echo lands on the same
+// cell. Predictions stay hidden until an echo has been confirmed since the
+// last Enter or control key, so no-echo prompts (passwords) never show them.
+#define PREDICT_MAX 64
+#define PREDICT_TIMEOUT_MS 1500
+static struct prediction {
+    int16_t row;
+    int16_t col;
+    uint32_t ch;
+    unsigned long time_ms;
+} predictions[PREDICT_MAX];
+static int prediction_count = 0;
+static int prediction_trusted = 0;
+static struct display_rect prediction_rect;  // drawn, not yet on the panel
+
+// Refresh behavior requested by the application through EPD_OSC_NUMBER
+static enum display_mode refresh_mode = DISPLAY_MODE_AUTO;
+static int refresh_paused = 0;
+static int force_full_refresh = 0;
+
+// How SGR colors are folded into cell attributes on the mono panel
+//   mono: foreground colors are all ink, any background other than the
+//         default or white shows as reverse video
+//   gray: light foreground colors are dimmed (stippled), only dark
+//         backgrounds show as reverse video
+enum color_policy {
+    COLOR_POLICY_MONO,
+    COLOR_POLICY_GRAY
+};
+static enum color_policy color_policy = COLOR_POLICY_MONO;
+
+// Current SGR pen. Cells get (pen_style | pen_fg) ^ pen_bg; erased cells
+// only take pen_bg, like a colored background on other terminals.
+static uint8_t pen_style = 0;   // bold, underline, reverse, dim, strike
+static uint8_t pen_fg = 0;      // ATTR_DIM for a light foreground (gray)
+static uint8_t pen_bg = 0;      // ATTR_REVERSE for a colored background
+
+// Scroll region (DECSTBM), inclusive row bounds
+static int scroll_top = 0;
+static int scroll_bottom = 0;
+
+// Pixels that were moved inside the framebuffer by a scroll rather than
+// re-rasterized; still needs to reach the panel on the next refresh
+static struct display_rect moved_rect;
+
+// Per-row damaged column span [start, end), empty when start >= end
+static struct row_span {
+    int16_t start;
+    int16_t end;
+} *row_damage = NULL;
+
+// Scrollback viewing: how many lines the viewport is scrolled back, and a
+// snapshot grid of what it shows. Live damage keeps accumulating underneath
+// and is drawn once the view returns to the bottom.
+static int view_offset = 0;
+static int view_dirty = 0;
+static struct term_cell *view_storage = NULL;
+static struct term_cell **view_rows = NULL;
 
 // ANSI escape sequence parser state
 static enum {
@@ -49,29 +166,62 @@ static enum {
 static char escape_buffer[256];
 static int escape_pos = 0;
 
+static struct tsm_term_stats stats;
+
+// UTF-8 decoder state for printable text
+static uint32_t utf8_codepoint = 0;
+static uint32_t utf8_min = 0;     // smallest code point the sequence may encode
+static int utf8_remaining = 0;
+
 // Forward declarations
-static void set_pixel(int x, int y, int color);
-static void draw_char(int x, int y, char ch, int fg_color, int bg_color, uint8_t attrs);
-static void scroll_up(void);
+static void clamp_to_panel(int *rows, int *cols);
+static int alloc_grid(int rows, int cols);
+static void set_alt_screen(int enable, int clear, int save_cursor);
+static void set_private_mode(int mode, int enable);
+static int parse_params(const char *seq, int *params, int max_params);
+static int private_mode_state(int mode);
+static void send_reply(const char *fmt, ...);
+static void answer_query(char cmd, const char *seq, int len);
+static void clear_cell(struct term_cell *cell);
+static void damage_span(int row, int col_start, int col_end);
+static void damage_rows(int row_start, int row_end);
+static void draw_cell(int row, int col, const struct term_cell *cell, int cells);
+static void draw_cells(int row, const struct term_cell *cells, int start, int end);
+static void split_wide(int row, int col);
+static void scroll_view(int lines);
+static void free_view(void);
+static int render_view(struct display_rect *rect);
+static void line_feed(void);
+static void scroll_region_up(int top, int bottom, int n, int keep_history);
+static void scroll_region_down(int top, int bottom, int n);
+static void insert_chars(int n);
+static void delete_chars(int n);
+static void erase_chars(int n);
 static void clear_screen(void);
 static void move_cursor(int row, int col);
+static int decode_utf8(unsigned char ch);
+static void put_char(uint32_t ch);
+static unsigned long now_ms(void);
+static void predict_char(uint32_t ch);
+static void check_prediction(int row, int col, uint32_t ch);
+static void cancel_predictions(int distrust);
+static void draw_predictions(struct display_rect *rect);
+static int cell_equal(const struct term_cell *a, const struct term_cell *b);
 static void process_csi_sequence(const char *seq, int len);
-static void render_screen(void);
-static char keycode_to_ascii(uint32_t keycode, int shift_pressed);
+static void set_graphics(const char *seq, int len);
+static void process_osc_sequence(const char *seq);
+static int render_screen(struct display_rect *rect);
 static void flush_output_buffer(void);
-static void process_buffered_output(void);
+static size_t process_buffered_output(size_t max_bytes, unsigned long max_us);
 
 int tsm_term_init(int rows, int cols, int pty, uint8_t *buffer) {
-    printf("tsm_term_init: %dx%d\n", cols, rows);
+    log_info("tsm_term_init: %dx%d", cols, rows);
     
     if (rows <= 0 || cols <= 0 || !buffer) {
         return -1;
     }
     
-    // Limit to safe sizes
-    term_rows = (rows > 24) ? 24 : rows;
-    term_cols = (cols > 80) ? 80 : cols;
-    
+    clamp_to_panel(&rows, &cols);
     framebuffer = buffer;
     buffer_size = (EPD_7IN5_V2_WIDTH * EPD_7IN5_V2_HEIGHT) / 8;
     pty_fd = pty;
@@ -80,41 +230,157 @@ int tsm_term_init(int rows, int cols, int pty, uint8_t *buffer) {
     cursor_col = 0;
     parser_state = STATE_NORMAL;
     escape_pos = 0;
+    utf8_remaining = 0;
+    sync_update_active = 0;
+    sync_frame_complete = 0;
+    refresh_mode = DISPLAY_MODE_AUTO;
+    refresh_paused = 0;
+    pen_style = pen_fg = pen_bg = 0;
+    key_modes = 0;
+    force_full_refresh = 0;
+    prediction_count = 0;
+    prediction_trusted = 0;
     
     // Initialize output buffer
+    input_queue_len = 0;
     output_buffer_pos = 0;
+    output_parse_pos = 0;
     output_buffer_dirty = 0;
     
-    // Clear screen buffer
-    for (int r = 0; r < term_rows; r++) {
-        for (int c = 0; c < term_cols; c++) {
-            screen_buffer[r][c].ch = ' ';
-            screen_buffer[r][c].fg_color = COLOR_BLACK;
-            screen_buffer[r][c].bg_color = COLOR_WHITE;
-            screen_buffer[r][c].attrs = 0;
-        }
+    // Allocate and clear screen buffer
+    if (alloc_grid(rows, cols) != 0) {
+        return -1;
+    }
+    scrollback_init(SCROLLBACK_MAX_BYTES);
+
+    const char *font_path = getenv("EPD_FONT");
+    if (glyph_cache_init(font_path ? font_path : FALLBACK_FONT_PATH,
+                         cell_width, cell_height) != 0) {
+        log_warn("No fallback font, characters outside ASCII show as '?'");
     }
     
     // Clear framebuffer to white
     memset(framebuffer, 0xFF, buffer_size);
     
-    damage_pending = 1;
+    damage_rows(0, term_rows);
     
-    printf("TSM terminal initialized: %dx%d\n", term_cols, term_rows);
+    log_info("TSM terminal initialized: %dx%d", term_cols, term_rows);
     return 0;
 }
 
 void tsm_term_destroy(void) {
     // Flush any remaining output
     flush_output_buffer();
+
+    log_info("Scrollback: %d lines, %zu of %zu bytes", scrollback_count(),
+           scrollback_memory_used(), scrollback_memory_limit());
+    free_view();
+    scrollback_destroy();
+
+    unsigned long hits, misses, evictions;
+    glyph_cache_stats(&hits, &misses, &evictions);
+    log_info("Glyph cache: %lu hits, %lu misses, %lu evictions", hits, misses, evictions);
+    glyph_cache_destroy();
     
+    free(screen_buffer);
+    free(cell_storage);
+    free(alt_buffer);
+    free(alt_storage);
+    free(row_damage);
+    screen_buffer = NULL;
+    cell_storage = NULL;
+    alt_buffer = NULL;
+    alt_storage = NULL;
+    alt_screen_active = 0;
+    row_damage = NULL;
+    term_rows = term_cols = 0;
+
     framebuffer = NULL;
     buffer_size = 0;
     pty_fd = -1;
     output_buffer_pos = 0;
+    output_parse_pos = 0;
     output_buffer_dirty = 0;
 }
 
+void tsm_term_grid_for_panel(int width, int height, int *rows, int *cols) {
+    *cols = width / cell_width;
+    *rows = height / cell_height;
+}
+
+int tsm_term_set_font(const char *name) {
+    const struct font_table *table = font_table_find(name);
+    if (!table) {
+        log_warn("tsm_term_set_font: no compiled font '%s'", name);
+        return -1;
+    }
+    if (table->cell_width == 0 || table->cell_width % 8 != 0 || table->cell_height == 0) {
+        log_warn("tsm_term_set_font: unsupported cell size %dx%d",
+               table->cell_width, table->cell_height);
+        return -1;
+    }
+
+    font = table;
+    cell_width = table->cell_width;
+    cell_height = table->cell_height;
+    cell_bytes = table->bytes_per_row;
+    log_info("Font %s: %dx%d cells, %d glyphs", table->name, cell_width, cell_height,
+           table->glyph_count);
+
+    // Before init this only picks the cell size the grid is computed from
+    if (!framebuffer) {
+        return 0;
+    }
+
+    const char *font_path = getenv("EPD_FONT");
+    if (glyph_cache_init(font_path ? font_path : FALLBACK_FONT_PATH,
+                         cell_width, cell_height) != 0) {
+        log_warn("No fallback font, characters outside the table show as '?'");
+    }
+
+    int rows, cols;
+    tsm_term_grid_for_panel(EPD_7IN5_V2_WIDTH, EPD_7IN5_V2_HEIGHT, &rows, &cols);
+    if (rows == term_rows && cols == term_cols) {
+        // Same grid, but every cell has to be rasterized with the new glyphs
+        memset(framebuffer, 0xFF, buffer_size);
+        damage_rows(0, term_rows);
+        panel_damaged = 1;
+        return 0;
+    }
+    return tsm_term_resize(rows, cols);
+}
+
+int tsm_term_resize(int rows, int cols) {
+    if (rows <= 0 || cols <= 0) {
+        return -1;
+    }
+    clamp_to_panel(&rows, &cols);
+    if (rows == term_rows && cols == term_cols) {
+        return 0;
+    }
+
+    // Parse everything that arrived for the old geometry first
+    flush_output_buffer();
+
+    if (alloc_grid(rows, cols) != 0) {
+        return -1;
+    }
+
+    // Cells that no longer exist on the panel have to be painted white
+    if (framebuffer) {
+        memset(framebuffer, 0xFF, buffer_size);
+    }
+    damage_rows(0, term_rows);
+    panel_damaged = 1;
+
+    if (pty_fd >= 0 && pty_resize(pty_fd, rows, cols) != 0) {
+        log_warn("pty_resize: %s", strerror(errno));
+    }
+
+    log_info("TSM terminal resized: %dx%d", term_cols, term_rows);
+    return 0;
+}
+
 void tsm_term_feed_output(const char *data, size_t len, uint8_t *buffer) {
     if (!data || len == 0 || !buffer) {
         return;
@@ -122,417 +388,1386 @@ void tsm_term_feed_output(const char *data, size_t len, uint8_t *buffer) {
     
     framebuffer = buffer;
     
-    printf("tsm_term_feed_output: %zu bytes: ", len);
-    // Print first 40 chars for debugging
-    for (size_t i = 0; i < len && i < 40; i++) {
-        if (data[i] >= 32 && data[i] <= 126) {
-            printf("%c", data[i]);
-        } else {
-            printf("\\x%02x", (unsigned char)data[i]);
-        }
-    }
-    printf("\n");
+    log_debug("tsm_term_feed_output: %zu bytes: %.*s", len, (int)(len < 40 ? len : 40), data);
     
-    // Add to output buffer instead of processing immediately
-    for (size_t i = 0; i < len; i++) {
-        if (output_buffer_pos < OUTPUT_BUFFER_SIZE - 1) {
-            output_buffer[output_buffer_pos++] = data[i];
-            output_buffer_dirty = 1;
-        } else {
-            // Buffer full, process what we have
-            printf("Output buffer full, processing...\n");
-            process_buffered_output();
-            output_buffer[0] = data[i];
-            output_buffer_pos = 1;
-            output_buffer_dirty = 1;
+    // Queue for tsm_term_parse. Parsed bytes are dropped to make room; a
+    // caller that reads more than tsm_term_output_space reported makes us
+    // parse synchronously instead.
+    while (len > 0) {
+        if (output_parse_pos > 0) {
+            memmove(output_buffer, output_buffer + output_parse_pos,
+                    output_buffer_pos - output_parse_pos);
+            output_buffer_pos -= output_parse_pos;
+            output_parse_pos = 0;
         }
+        if (output_buffer_pos == OUTPUT_BUFFER_SIZE) {
+            log_debug("Output buffer full, processing...");
+            process_buffered_output(0, 0);
+            continue;
+        }
+
+        size_t chunk = OUTPUT_BUFFER_SIZE - output_buffer_pos;
+        if (chunk > len) chunk = len;
+        memcpy(output_buffer + output_buffer_pos, data, chunk);
+        output_buffer_pos += chunk;
+        output_buffer_dirty = 1;
+        data += chunk;
+        len -= chunk;
     }
-    
-    printf("Output buffered: %zu chars total\n", output_buffer_pos);
 }
 
-static void process_buffered_output(void) {
-    if (!output_buffer_dirty || output_buffer_pos == 0) {
-        return;
+size_t tsm_term_output_space(void) {
+    return OUTPUT_BUFFER_SIZE - (output_buffer_pos - output_parse_pos);
+}
+
+size_t tsm_term_parse(size_t max_bytes, unsigned long max_us) {
+    return process_buffered_output(max_bytes, max_us);
+}
+
+static unsigned long elapsed_us(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000UL +
+           (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+// Parse queued output in slices until it is gone, max_bytes have been
+// parsed or max_us have passed (0 = no limit). Returns the bytes left.
+static size_t process_buffered_output(size_t max_bytes, unsigned long max_us) {
+    if (!output_buffer_dirty || output_buffer_pos == output_parse_pos) {
+        return 0;
     }
-    
-    printf("Processing %zu buffered characters\n", output_buffer_pos);
-    
-    for (size_t i = 0; i < output_buffer_pos; i++) {
-        char ch = output_buffer[i];
+
+    struct timespec start;
+    if (max_us) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    size_t parsed = 0;
+
+    while (output_parse_pos < output_buffer_pos) {
+        size_t end = output_buffer_pos;
+        if (end - output_parse_pos > PARSE_SLICE) {
+            end = output_parse_pos + PARSE_SLICE;
+        }
+        if (max_bytes && end - output_parse_pos > max_bytes - parsed) {
+            end = output_parse_pos + (max_bytes - parsed);
+        }
+
+        for (size_t i = output_parse_pos; i < end; i++) {
+            unsigned char ch = output_buffer[i];
         
-        switch (parser_state) {
-            case STATE_NORMAL:
-                switch (ch) {
-                    case '\r':  // Carriage return
-                        cursor_col = 0;
-                        break;
+            if (parser_state == STATE_NORMAL && decode_utf8(ch)) {
+                continue;
+            }
+        
+            switch (parser_state) {
+                case STATE_NORMAL:
+                    switch (ch) {
+                        case '\r':  // Carriage return
+                            cursor_col = 0;
+                            break;
                         
-                    case '\n':  // Line feed
-                        cursor_row++;
-                        if (cursor_row >= term_rows) {
-                            scroll_up();
-                            cursor_row = term_rows - 1;
-                        }
-                        break;
+                        case '\n':  // Line feed
+                            line_feed();
+                            break;
                         
-                    case '\t':  // Tab
-                        cursor_col = ((cursor_col + 8) / 8) * 8;
-                        if (cursor_col >= term_cols) {
-                            cursor_col = 0;
-                            cursor_row++;
-                            if (cursor_row >= term_rows) {
-                                scroll_up();
-                                cursor_row = term_rows - 1;
+                        case '\t':  // Tab
+                            cursor_col = ((cursor_col + 8) / 8) * 8;
+                            if (cursor_col >= term_cols) {
+                                cursor_col = 0;
+                                line_feed();
                             }
-                        }
-                        break;
+                            break;
                         
-                    case '\b':  // Backspace
-                        if (cursor_col > 0) {
-                            cursor_col--;
-                            screen_buffer[cursor_row][cursor_col].ch = ' ';
-                            damage_pending = 1;
-                        }
-                        break;
+                        case '\b':  // Backspace
+                            if (cursor_col > 0) {
+                                cursor_col--;
+                                screen_buffer[cursor_row][cursor_col].ch = ' ';
+                                damage_span(cursor_row, cursor_col, cursor_col + 1);
+                            }
+                            break;
                         
-                    case 0x1B:  // Escape
-                        parser_state = STATE_ESCAPE;
-                        escape_pos = 0;
-                        break;
+                        case 0x1B:  // Escape
+                            parser_state = STATE_ESCAPE;
+                            escape_pos = 0;
+                            break;
                         
-                    case 0x07:  // Bell - ignore
-                        break;
+                        case 0x07:  // Bell - ignore
+                            break;
                         
-                    default:
-                        if (ch >= 0x20 && ch <= 0x7E) {  // Printable ASCII
-                            if (cursor_row < term_rows && cursor_col < term_cols) {
-                                screen_buffer[cursor_row][cursor_col].ch = ch;
-                                screen_buffer[cursor_row][cursor_col].fg_color = COLOR_BLACK;
-                                screen_buffer[cursor_row][cursor_col].bg_color = COLOR_WHITE;
-                                screen_buffer[cursor_row][cursor_col].attrs = 0;
-                                damage_pending = 1;
-                                cursor_col++;
-                                
-                                if (cursor_col >= term_cols) {
-                                    cursor_col = 0;
-                                    cursor_row++;
-                                    if (cursor_row >= term_rows) {
-                                        scroll_up();
-                                        cursor_row = term_rows - 1;
-                                    }
-                                }
+                        default:
+                            if (ch >= 0x20 && ch <= 0x7E) {  // Printable ASCII
+                                put_char(ch);
                             }
-                        }
-                        break;
-                }
-                break;
+                            break;
+                    }
+                    break;
                 
-            case STATE_ESCAPE:
-                if (ch == '[') {
-                    parser_state = STATE_CSI;
-                    escape_pos = 0;
-                } else if (ch == ']') {
-                    parser_state = STATE_OSC;
-                    escape_pos = 0;
-                } else {
-                    // Single character escape sequence, ignore for now
-                    parser_state = STATE_NORMAL;
-                }
-                break;
+                case STATE_ESCAPE:
+                    if (ch == '[') {
+                        parser_state = STATE_CSI;
+                        escape_pos = 0;
+                    } else if (ch == ']') {
+                        parser_state = STATE_OSC;
+                        escape_pos = 0;
+                    } else if (ch == 'D') { // Index
+                        line_feed();
+                        parser_state = STATE_NORMAL;
+                    } else if (ch == 'E') { // Next line
+                        cursor_col = 0;
+                        line_feed();
+                        parser_state = STATE_NORMAL;
+                    } else if (ch == '=' || ch == '>') { // Keypad application/numeric mode
+                        key_modes = (ch == '=') ? (key_modes | KEYMAP_APP_KEYPAD) : (key_modes & ~KEYMAP_APP_KEYPAD);
+                        parser_state = STATE_NORMAL;
+                    } else if (ch == 'M') { // Reverse index
+                        if (cursor_row == scroll_top) {
+                            scroll_region_down(scroll_top, scroll_bottom, 1);
+                        } else if (cursor_row > 0) {
+                            cursor_row--;
+                        }
+                        parser_state = STATE_NORMAL;
+                    } else {
+                        // Single character escape sequence, ignore for now
+                        parser_state = STATE_NORMAL;
+                    }
+                    if (parser_state == STATE_NORMAL) {
+                        stats.escapes[TSM_ESCAPE_OTHER]++;
+                    }
+                    break;
                 
-            case STATE_CSI:
-                if (escape_pos < sizeof(escape_buffer) - 1) {
-                    escape_buffer[escape_pos++] = ch;
-                }
+                case STATE_CSI:
+                    if (escape_pos < sizeof(escape_buffer) - 1) {
+                        escape_buffer[escape_pos++] = ch;
+                    }
                 
-                // CSI sequence ends with a letter
-                if ((ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z')) {
-                    escape_buffer[escape_pos] = '\0';
-                    process_csi_sequence(escape_buffer, escape_pos);
-                    parser_state = STATE_NORMAL;
-                }
-                break;
+                    // CSI sequence ends with a final byte in 0x40-0x7E
+                    if (ch >= 0x40 && ch <= 0x7E) {
+                        escape_buffer[escape_pos] = '\0';
+                        process_csi_sequence(escape_buffer, escape_pos);
+                        stats.escapes[TSM_ESCAPE_CSI]++;
+                        parser_state = STATE_NORMAL;
+                    }
+                    break;
                 
-            case STATE_OSC:
-                // OSC sequences end with BEL (0x07) or ESC backslash
-                if (ch == 0x07) {
-                    parser_state = STATE_NORMAL;
-                } else if (ch == 0x1B) {
-                    // Might be ESC backslash sequence, but for simplicity just reset
-                    parser_state = STATE_NORMAL;
-                }
-                break;
+                case STATE_OSC:
+                    // OSC sequences end with BEL (0x07) or ESC backslash. The
+                    // backslash after ESC is swallowed as a no-op escape.
+                    if (ch == 0x07 || ch == 0x1B) {
+                        escape_buffer[escape_pos] = '\0';
+                        process_osc_sequence(escape_buffer);
+                        stats.escapes[TSM_ESCAPE_OSC]++;
+                        parser_state = (ch == 0x1B) ? STATE_ESCAPE : STATE_NORMAL;
+                        escape_pos = 0;
+                    } else if (escape_pos < sizeof(escape_buffer) - 1) {
+                        escape_buffer[escape_pos++] = ch;
+                    }
+                    break;
+            }
         }
-    }
-    
-    // Clear the buffer
-    output_buffer_pos = 0;
-    output_buffer_dirty = 0;
     
-    printf("Cursor position: %d,%d\n", cursor_row, cursor_col);
+        parsed += end - output_parse_pos;
+        stats.bytes_parsed += end - output_parse_pos;
+        output_parse_pos = end;
+        if ((max_bytes && parsed >= max_bytes) || (max_us && elapsed_us(&start) >= max_us)) {
+            break;
+        }
+    }
+
+    // Output that follows a key write is taken as its echo; an approximation,
+    // see latency.h
+    latency_advance(LATENCY_WRITTEN, LATENCY_ECHO);
+
+    size_t left = output_buffer_pos - output_parse_pos;
+    if (left == 0) {
+        output_buffer_pos = output_parse_pos = 0;
+        output_buffer_dirty = 0;
+    }
+    return left;
 }
 
-static void flush_output_buffer(void) {
-    if (output_buffer_dirty) {
-        process_buffered_output();
+// Feed a byte of text through the UTF-8 decoder. Returns 0 for plain ASCII
+// that still needs normal handling. Malformed input shows as U+FFFD.
+static int decode_utf8(unsigned char ch) {
+    if (utf8_remaining > 0) {
+        if ((ch & 0xC0) == 0x80) {
+            utf8_codepoint = (utf8_codepoint << 6) | (ch & 0x3F);
+            if (--utf8_remaining == 0) {
+                uint32_t cp = utf8_codepoint;
+                if (cp < utf8_min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                    cp = 0xFFFD;
+                }
+                put_char(cp);
+            }
+            return 1;
+        }
+        utf8_remaining = 0;
+        put_char(0xFFFD); // sequence cut short
+    }
+
+    if (ch < 0x80) {
+        return 0;
+    }
+    if (ch >= 0xC2 && ch <= 0xDF) {
+        utf8_codepoint = ch & 0x1F;
+        utf8_remaining = 1;
+        utf8_min = 0x80;
+    } else if (ch >= 0xE0 && ch <= 0xEF) {
+        utf8_codepoint = ch & 0x0F;
+        utf8_remaining = 2;
+        utf8_min = 0x800;
+    } else if (ch >= 0xF0 && ch <= 0xF4) {
+        utf8_codepoint = ch & 0x07;
+        utf8_remaining = 3;
+        utf8_min = 0x10000;
+    } else {
+        put_char(0xFFFD);
     }
+    return 1;
 }
 
-void tsm_term_process_input(uint32_t keycode, int modifiers) {
-    if (pty_fd < 0) {
-        printf("ERROR: PTY not available (fd=%d)\n", pty_fd);
+// Store a printable character at the cursor and advance
+static void put_char(uint32_t ch) {
+    if (cursor_row >= term_rows || cursor_col >= term_cols) {
         return;
     }
 
-    printf("Processing key: %u, modifiers: %d\n", keycode, modifiers);
+    if (prediction_count > 0) {
+        check_prediction(cursor_row, cursor_col, ch);
+    }
 
-    // Check for modifier keys
-    int ctrl_pressed = (modifiers & 0x04) != 0;
-    int shift_pressed = (modifiers & 0x01) != 0;
+    // Combining marks have no cell of their own and are dropped
+    int width = char_width(ch);
+    if (width == 0) {
+        return;
+    }
+    if (width == 2 && term_cols < 2) {
+        width = 1;
+    }
+    if (width == 2 && cursor_col == term_cols - 1) {
+        // Both halves must land on one row
+        split_wide(cursor_row, cursor_col);
+        clear_cell(&screen_buffer[cursor_row][cursor_col]);
+        damage_span(cursor_row, cursor_col, cursor_col + 1);
+        cursor_col = 0;
+        line_feed();
+    }
 
-    // Handle special keys first
-    switch (keycode) {
-        case KEY_ENTER:
-            printf("Sending ENTER (\\r) to PTY\n");
-            if (write(pty_fd, "\r", 1) < 0) {
-                perror("write ENTER failed");
-            }
-            return;
-        case KEY_BACKSPACE:
-            printf("Sending BACKSPACE (\\b) to PTY\n");
-            if (write(pty_fd, "\b", 1) < 0) {
-                perror("write BACKSPACE failed");
-            }
-            return;
-        case KEY_TAB:
-            printf("Sending TAB (\\t) to PTY\n");
-            if (write(pty_fd, "\t", 1) < 0) {
-                perror("write TAB failed");
-            }
-            return;
-        case KEY_ESC:
-            printf("Sending ESC to PTY\n");
-            if (write(pty_fd, "\x1b", 1) < 0) {
-                perror("write ESC failed");
-            }
-            return;
-        case KEY_UP:
-            printf("Sending UP arrow to PTY\n");
-            if (write(pty_fd, "\x1b[A", 3) < 0) {
-                perror("write UP failed");
-            }
-            return;
-        case KEY_DOWN:
-            printf("Sending DOWN arrow to PTY\n");
-            if (write(pty_fd, "\x1b[B", 3) < 0) {
-                perror("write DOWN failed");
-            }
-            return;
-        case KEY_RIGHT:
-            printf("Sending RIGHT arrow to PTY\n");
-            if (write(pty_fd, "\x1b[C", 3) < 0) {
-                perror("write RIGHT failed");
-            }
-            return;
-        case KEY_LEFT:
-            printf("Sending LEFT arrow to PTY\n");
-            if (write(pty_fd, "\x1b[D", 3) < 0) {
-                perror("write LEFT failed");
-            }
-            return;
-        case KEY_HOME:
-            if (write(pty_fd, "\x1b[H", 3) < 0) {
-                perror("write HOME failed");
-            }
-            return;
-        case KEY_END:
-            if (write(pty_fd, "\x1b[F", 3) < 0) {
-                perror("write END failed");
-            }
-            return;
-        case KEY_PAGEUP:
-            if (write(pty_fd, "\x1b[5~", 4) < 0) {
-                perror("write PAGEUP failed");
-            }
-            return;
-        case KEY_PAGEDOWN:
-            if (write(pty_fd, "\x1b[6~", 4) < 0) {
-                perror("write PAGEDOWN failed");
-            }
-            return;
-        case KEY_DELETE:
-            if (write(pty_fd, "\x1b[3~", 4) < 0) {
-                perror("write DELETE failed");
-            }
-            return;
+    split_wide(cursor_row, cursor_col);
+    if (width == 2) {
+        split_wide(cursor_row, cursor_col + 1);
     }
 
-    // Handle printable characters
-    char ascii_char = keycode_to_ascii(keycode, shift_pressed);
-    if (ascii_char != 0) {
-        if (ctrl_pressed && ascii_char >= 'a' && ascii_char <= 'z') {
-            // Convert to control character
-            char ctrl_char = ascii_char - 'a' + 1;
-            printf("Sending Ctrl+%c (0x%02x) to PTY\n", ascii_char, (unsigned char)ctrl_char);
-            if (write(pty_fd, &ctrl_char, 1) < 0) {
-                perror("write ctrl char failed");
-            }
-        } else if (ctrl_pressed && ascii_char >= 'A' && ascii_char <= 'Z') {
-            // Convert to control character
-            char ctrl_char = ascii_char - 'A' + 1;
-            printf("Sending Ctrl+%c (0x%02x) to PTY\n", ascii_char, (unsigned char)ctrl_char);
-            if (write(pty_fd, &ctrl_char, 1) < 0) {
-                perror("write ctrl char failed");
-            }
-        } else {
-            printf("Sending ASCII '%c' (0x%02x) to PTY\n", ascii_char, (unsigned char)ascii_char);
-            if (write(pty_fd, &ascii_char, 1) < 0) {
-                perror("write ascii char failed");
-            }
-        }
-    } else {
-        printf("Unhandled keycode: %u\n", keycode);
+    struct term_cell *cell = &screen_buffer[cursor_row][cursor_col];
+    uint8_t attrs = (pen_style | pen_fg) ^ pen_bg;
+    cell->ch = ch;
+    cell->attrs = (width == 2) ? attrs | ATTR_WIDE : attrs;
+    if (width == 2) {
+        cell[1].ch = ' ';
+        cell[1].attrs = attrs | ATTR_WIDE_CONT;
+    }
+    damage_span(cursor_row, cursor_col, cursor_col + width);
+    cursor_col += width;
+
+    if (cursor_col >= term_cols) {
+        cursor_col = 0;
+        line_feed();
     }
 }
 
-void tsm_term_redraw(uint8_t *buffer) {
-    if (!buffer) {
+static unsigned long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+// Record a typed character at the cell after the last prediction (or the
+// cursor) and draw it if predictions are currently trusted
+static void predict_char(uint32_t ch) {
+    // Full-screen programs and paused or mid-frame screens echo in ways a
+    // prompt doesn't; leave them alone
+    if (alt_screen_active || view_offset > 0 || sync_update_active || refresh_paused) {
         return;
     }
-    
-    framebuffer = buffer;
-    
-    // Process any buffered output first
-    flush_output_buffer();
-    
-    if (!damage_pending) {
-        printf("No damage pending, skipping redraw\n");
+
+    int row = cursor_row;
+    int col = cursor_col;
+    if (prediction_count > 0) {
+        row = predictions[prediction_count - 1].row;
+        col = predictions[prediction_count - 1].col + 1;
+    }
+    if (prediction_count == PREDICT_MAX || row >= term_rows || col >= term_cols) {
+        return;  // no guessing across line wraps
+    }
+
+    struct prediction *p = &predictions[prediction_count++];
+    p->row = row;
+    p->col = col;
+    p->ch = ch;
+    p->time_ms = now_ms();
+
+    if (prediction_trusted && framebuffer) {
+        struct term_cell cell = { ch, 0 };
+        draw_cell(row, col, &cell, 1);
+        latency_mark_predicted();
+        struct display_rect r = {
+            col * cell_width, row * cell_height,
+            (col + 1) * cell_width, (row + 1) * cell_height
+        };
+        display_rect_union(&prediction_rect, &r);
+    }
+}
+
+// Real output is landing on row, col: the oldest prediction is confirmed
+// if it matches, otherwise every outstanding guess is wrong
+static void check_prediction(int row, int col, uint32_t ch) {
+    struct prediction *p = &predictions[0];
+    if (p->row != row || p->col != col) {
         return;
     }
-    
-    printf("Redrawing terminal screen\n");
-    render_screen();
-    tsm_flush_display();
-    damage_pending = 0;
+    if (p->ch != ch) {
+        cancel_predictions(1);
+        return;
+    }
+
+    prediction_count--;
+    memmove(&predictions[0], &predictions[1], prediction_count * sizeof(*predictions));
+    if (!prediction_trusted) {
+        prediction_trusted = 1;
+    }
 }
 
-int tsm_term_has_pending_damage(void) {
-    return damage_pending || output_buffer_dirty;
+// Drop all predictions; shown ones are damaged so the real cells are drawn
+// back over them
+static void cancel_predictions(int distrust) {
+    if (prediction_trusted) {
+        for (int i = 0; i < prediction_count; i++) {
+            damage_span(predictions[i].row, predictions[i].col, predictions[i].col + 1);
+        }
+    }
+    prediction_count = 0;
+    prediction_rect.x_start = prediction_rect.y_start = 0;
+    prediction_rect.x_end = prediction_rect.y_end = 0;
+    if (distrust) {
+        prediction_trusted = 0;
+    }
 }
 
-void tsm_flush_display(void) {
-    if (framebuffer) {
-        printf("Flushing display to E-ink\n");
-        EPD_7IN5_V2_Display(framebuffer);
+// Overlay shown predictions on whatever was just rendered
+static void draw_predictions(struct display_rect *rect) {
+    if (!prediction_trusted) return;
+    for (int i = 0; i < prediction_count; i++) {
+        struct term_cell cell = { predictions[i].ch, 0 };
+        draw_cell(predictions[i].row, predictions[i].col, &cell, 1);
+        struct display_rect r = {
+            predictions[i].col * cell_width, predictions[i].row * cell_height,
+            (predictions[i].col + 1) * cell_width, (predictions[i].row + 1) * cell_height
+        };
+        display_rect_union(rect, &r);
     }
 }
 
-// --- Internal Functions ---
+void tsm_term_flush_predictions(void) {
+    // An echo that never came means the guess was wrong (or echo is off)
+    if (prediction_count > 0 && now_ms() - predictions[0].time_ms > PREDICT_TIMEOUT_MS) {
+        trace(TRACE_PREDICT_TIMEOUT, prediction_count, 0);
+        cancel_predictions(1);
+    }
 
-static void set_pixel(int x, int y, int color) {
-    if (!framebuffer || x < 0 || x >= EPD_7IN5_V2_WIDTH || y < 0 || y >= EPD_7IN5_V2_HEIGHT) {
+    if (!framebuffer || display_rect_is_empty(&prediction_rect)) {
         return;
     }
-    
-    int byte_index = (y * EPD_7IN5_V2_WIDTH + x) / 8;
-    int bit_index = 7 - (x % 8);
-    
-    if (byte_index < 0 || byte_index >= (int)buffer_size) {
-        return;
+    if (display_busy()) {
+        return;  // goes out once the panel is done with the last refresh
     }
-    
-    if (color == COLOR_BLACK) {
-        framebuffer[byte_index] &= ~(1 << bit_index);
-    } else {
-        framebuffer[byte_index] |= (1 << bit_index);
+    if (!refresh_paused && !sync_update_active) {
+        // The predicted echo is the key's ink, whether or not it was written.
+        // Other keys typed meanwhile still wait for the shell's output.
+        latency_advance_predicted(LATENCY_KEY, LATENCY_RENDER);
+        display_refresh_rect(&prediction_rect);
     }
+    prediction_rect.x_start = prediction_rect.y_start = 0;
+    prediction_rect.x_end = prediction_rect.y_end = 0;
 }
 
-static void draw_char(int x, int y, char ch, int fg_color, int bg_color, uint8_t attrs) {
-    extern const uint8_t font8x16[96][16];
-    
-    if (ch < 0x20 || ch > 0x7F) {
-        ch = '?';  // Replace unprintable characters with '?'
+long tsm_term_prediction_timeout(void) {
+    if (prediction_count == 0) {
+        return -1;
     }
-    
-    const uint8_t *glyph = font8x16[ch - 0x20];
+    unsigned long age = now_ms() - predictions[0].time_ms;
+    return age >= PREDICT_TIMEOUT_MS ? 0 : (long)(PREDICT_TIMEOUT_MS - age);
+}
 
-    // Draw background
-    if (bg_color == COLOR_BLACK) {
-        for (int row = 0; row < CELL_HEIGHT; row++) {
-            for (int col = 0; col < CELL_WIDTH; col++) {
-                set_pixel(x + col, y + row, COLOR_BLACK);
-            }
-        }
+static void flush_output_buffer(void) {
+    if (output_buffer_dirty) {
+        process_buffered_output(0, 0);
     }
+}
 
-    // Draw character
-    for (int row = 0; row < CELL_HEIGHT; row++) {
-        uint8_t bits = glyph[row];
-        for (int col = 0; col < CELL_WIDTH; col++) {
-            if (bits & (1 << (7 - col))) {
-                set_pixel(x + col, y + row, fg_color);
-            }
-        }
+// Append bytes for the PTY. Returns -1 (and drops them) only if the queue
+// is still full after trying to write it out.
+static int queue_input(const char *data, size_t len) {
+    if (input_queue_len + len > INPUT_QUEUE_SIZE) {
+        tsm_term_flush_input();
     }
-    
-    // Draw underline if needed
-    if (attrs & 1) { // underline
-        for (int col = 0; col < CELL_WIDTH; col++) {
-            set_pixel(x + col, y + CELL_HEIGHT - 2, fg_color);
-        }
+    if (input_queue_len + len > INPUT_QUEUE_SIZE) {
+        trace(TRACE_INPUT_DROP, len, input_queue_len);
+        log_warn("PTY input queue full, dropping %zu bytes", len);
+        return -1;
     }
+    memcpy(input_queue + input_queue_len, data, len);
+    input_queue_len += len;
+    return 0;
 }
 
-static void scroll_up(void) {
-    // Move all lines up by one
-    for (int r = 0; r < term_rows - 1; r++) {
-        for (int c = 0; c < term_cols; c++) {
-            screen_buffer[r][c] = screen_buffer[r + 1][c];
+void tsm_term_flush_input(void) {
+    size_t written = 0;
+    while (written < input_queue_len && pty_fd >= 0) {
+        ssize_t n = write(pty_fd, input_queue + written, input_queue_len - written);
+        if (n > 0) {
+            written += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            // The shell is gone; nothing will ever read the rest
+            log_error("write to PTY failed: %s", strerror(errno));
+            input_queue_len = 0;
+            return;
+        } else {
+            break;  // PTY full, the rest goes next turn
         }
     }
-    
-    // Clear the last line
-    for (int c = 0; c < term_cols; c++) {
-        screen_buffer[term_rows - 1][c].ch = ' ';
-        screen_buffer[term_rows - 1][c].fg_color = COLOR_BLACK;
-        screen_buffer[term_rows - 1][c].bg_color = COLOR_WHITE;
-        screen_buffer[term_rows - 1][c].attrs = 0;
+
+    memmove(input_queue, input_queue + written, input_queue_len - written);
+    input_queue_len -= written;
+    if (written > 0 && input_queue_len == 0) {
+        latency_advance(LATENCY_KEY, LATENCY_WRITTEN);
     }
-    
-    damage_pending = 1;
 }
 
-static void clear_screen(void) {
-    for (int r = 0; r < term_rows; r++) {
-        for (int c = 0; c < term_cols; c++) {
-            screen_buffer[r][c].ch = ' ';
-            screen_buffer[r][c].fg_color = COLOR_BLACK;
-            screen_buffer[r][c].bg_color = COLOR_WHITE;
-            screen_buffer[r][c].attrs = 0;
-        }
-    }
-    cursor_row = 0;
-    cursor_col = 0;
-    damage_pending = 1;
+size_t tsm_term_input_pending(void) {
+    return input_queue_len;
 }
 
-static void move_cursor(int row, int col) {
-    if (row >= 0 && row < term_rows) {
-        cursor_row = row;
+void tsm_term_process_input(uint32_t keycode, int modifiers) {
+    if (pty_fd < 0) {
+        log_error("PTY not available (fd=%d)", pty_fd);
+        return;
     }
-    if (col >= 0 && col < term_cols) {
-        cursor_col = col;
+
+    // Shift+PageUp/PageDown page through the scrollback locally
+    if ((modifiers & KEYBOARD_MOD_SHIFT) && (keycode == KEY_PAGEUP || keycode == KEY_PAGEDOWN)) {
+        scroll_view(keycode == KEY_PAGEUP ? term_rows : -term_rows);
+        latency_advance(LATENCY_KEY, LATENCY_ECHO);  // no round trip through the shell
+        return;
     }
-}
 
-static void process_csi_sequence(const char *seq, int len) {
-    if (len == 0) return;
+    char seq[KEYMAP_MAX_BYTES];
+    uint32_t typed;
+    int len = keymap_translate(keycode, modifiers, key_modes, seq, &typed);
+    if (len == 0) {
+        return;
+    }
+
+    // Anything else typed goes to the live screen
+    if (view_offset > 0) {
+        scroll_view(-view_offset);
+    }
+
+    // Keys other than plain text can move the cursor or rewrite the line,
+    // so outstanding predictions are dropped. After Enter or a control key
+    // the next prompt may not echo at all.
+    if (!typed) {
+        cancel_predictions(keycode == KEY_ENTER || keycode == KEY_KPENTER ||
+                           (modifiers & KEYBOARD_MOD_CTRL));
+    }
+
+    if (queue_input(seq, len) == 0 && typed) {
+        predict_char(typed);
+    }
+}
+
+enum display_mode tsm_term_redraw(uint8_t *buffer, enum display_mode mode) {
+    if (!buffer) {
+        return DISPLAY_MODE_AUTO;
+    }
+    
+    framebuffer = buffer;
+
+    // Only what tsm_term_parse got through is shown; the rest of the queue
+    // waits for the next turn's budgeted slice
+    if (refresh_paused && !force_full_refresh) {
+        stats.skipped_redraws++;
+        return DISPLAY_MODE_AUTO;
+    }
+    if (!damage_pending && !(view_offset > 0 && view_dirty)) {
+        log_debug("No damage pending, skipping redraw");
+        stats.skipped_redraws++;
+        return DISPLAY_MODE_AUTO;
+    }
+    if (display_busy()) {
+        // The panel can't take it yet; the damage stays for the next try
+        return DISPLAY_MODE_AUTO;
+    }
+    
+    struct display_rect rect;
+    if (!tsm_term_render(&rect) && !force_full_refresh) {
+        stats.skipped_redraws++;
+        return DISPLAY_MODE_AUTO;
+    }
+
+    latency_advance(LATENCY_ECHO, LATENCY_RENDER);
+    trace(TRACE_REDRAW, rect.y_start, rect.y_end);
+    log_debug("Redrawing terminal area %d,%d-%d,%d",
+           rect.x_start, rect.y_start, rect.x_end, rect.y_end);
+
+    // The application's choice wins over the caller's
+    if (refresh_mode != DISPLAY_MODE_AUTO) {
+        mode = refresh_mode;
+    }
+    if (force_full_refresh) {
+        mode = DISPLAY_MODE_QUALITY;
+        force_full_refresh = 0;
+    } else if (mode == DISPLAY_MODE_AUTO) {
+        // A whole-grid change gets the clean full refresh, anything smaller
+        // only pushes the area that was re-rasterized
+        if (rect.x_start == 0 && rect.y_start == 0 &&
+            rect.x_end >= term_cols * cell_width && rect.y_end >= term_rows * cell_height) {
+            mode = DISPLAY_MODE_QUALITY;
+        } else {
+            mode = DISPLAY_MODE_PARTIAL;
+        }
+    }
+
+    switch (mode) {
+        case DISPLAY_MODE_FAST:
+            display_refresh_fast();
+            break;
+        case DISPLAY_MODE_PARTIAL:
+            display_refresh_rect(&rect);
+            break;
+        default:
+            display_refresh_full();
+            break;
+    }
+    return mode;
+}
+
+int tsm_term_pending_area(struct display_rect *rect) {
+    rect->x_start = rect->y_start = rect->x_end = rect->y_end = 0;
+    if (view_offset > 0) {
+        if (view_dirty) {
+            rect->x_end = term_cols * cell_width;
+            rect->y_end = term_rows * cell_height;
+        }
+        return view_dirty;
+    }
+    if (!damage_pending) {
+        return 0;
+    }
+    if (panel_damaged) {
+        rect->x_end = EPD_7IN5_V2_WIDTH;
+        rect->y_end = EPD_7IN5_V2_HEIGHT;
+        return 1;
+    }
+
+    *rect = moved_rect;
+    for (int r = 0; r < term_rows; r++) {
+        if (row_damage[r].start >= row_damage[r].end) continue;
+        struct display_rect span = {
+            row_damage[r].start * cell_width, r * cell_height,
+            row_damage[r].end * cell_width, (r + 1) * cell_height
+        };
+        display_rect_union(rect, &span);
+    }
+    return !display_rect_is_empty(rect);
+}
+
+int tsm_term_render(struct display_rect *rect) {
+    if (!render_screen(rect)) {
+        return 0;
+    }
+    stats.frames++;
+    return 1;
+}
+
+void tsm_term_get_stats(struct tsm_term_stats *out) {
+    *out = stats;
+}
+
+int tsm_term_sync_update_active(void) {
+    return sync_update_active;
+}
+
+int tsm_term_take_frame_complete(void) {
+    int complete = sync_frame_complete;
+    sync_frame_complete = 0;
+    return complete;
+}
+
+int tsm_term_refresh_paused(void) {
+    return refresh_paused;
+}
+
+int tsm_term_has_pending_damage(void) {
+    if (view_offset > 0) {
+        return view_dirty;
+    }
+    return damage_pending || output_buffer_dirty;
+}
+
+void tsm_flush_display(void) {
+    if (framebuffer) {
+        log_debug("Flushing display to E-ink");
+        display_refresh_full();
+    }
+}
+
+// --- Internal Functions ---
+
+// The grid is never allowed to extend past the framebuffer
+static void clamp_to_panel(int *rows, int *cols) {
+    int max_rows, max_cols;
+    tsm_term_grid_for_panel(EPD_7IN5_V2_WIDTH, EPD_7IN5_V2_HEIGHT, &max_rows, &max_cols);
+    if (*rows > max_rows) *rows = max_rows;
+    if (*cols > max_cols) *cols = max_cols;
+}
+
+// Allocate a blank grid and copy in the part of old (old_rows x old_cols,
+// may be NULL) that still fits, starting shift rows down in the old grid
+static int new_grid(struct term_cell ***rows_out, struct term_cell **storage_out,
+                    struct term_cell **old, int old_rows, int old_cols,
+                    int rows, int cols, int shift) {
+    struct term_cell *storage = malloc((size_t)rows * cols * sizeof(*storage));
+    struct term_cell **row_ptrs = malloc(rows * sizeof(*row_ptrs));
+    if (!storage || !row_ptrs) {
+        free(storage);
+        free(row_ptrs);
+        return -1;
+    }
+
+    for (int r = 0; r < rows; r++) {
+        row_ptrs[r] = storage + (size_t)r * cols;
+        for (int c = 0; c < cols; c++) {
+            row_ptrs[r][c].ch = ' ';
+            row_ptrs[r][c].attrs = 0;
+        }
+    }
+
+    if (old) {
+        int copy_cols = (cols < old_cols) ? cols : old_cols;
+        for (int r = 0; r < rows && r + shift < old_rows; r++) {
+            memcpy(row_ptrs[r], old[r + shift], copy_cols * sizeof(*storage));
+        }
+    }
+
+    *rows_out = row_ptrs;
+    *storage_out = storage;
+    return 0;
+}
+
+// (Re)allocate the cell grids, keeping whatever overlaps the old ones. When
+// rows are lost the top is dropped so the cursor line stays on screen.
+static int alloc_grid(int rows, int cols) {
+    cancel_predictions(1);
+
+    int shift = 0;
+    if (cursor_row >= rows) {
+        shift = cursor_row - rows + 1;
+    }
+
+    struct term_cell **row_ptrs = NULL, **alt_ptrs = NULL;
+    struct term_cell *storage = NULL, *alt_new = NULL;
+    struct row_span *damage = calloc(rows, sizeof(*damage));
+    if (!damage ||
+        new_grid(&row_ptrs, &storage, screen_buffer, term_rows, term_cols,
+                 rows, cols, shift) != 0 ||
+        (alt_buffer && new_grid(&alt_ptrs, &alt_new, alt_buffer, term_rows, term_cols,
+                                rows, cols, shift) != 0)) {
+        log_error("alloc_grid: out of memory for %dx%d", cols, rows);
+        free(damage);
+        free(row_ptrs);
+        free(storage);
+        return -1;
+    }
+
+    free(screen_buffer);
+    free(cell_storage);
+    free(alt_buffer);
+    free(alt_storage);
+    free(row_damage);
+    free_view();
+    view_offset = 0;
+    screen_buffer = row_ptrs;
+    cell_storage = storage;
+    alt_buffer = alt_ptrs;
+    alt_storage = alt_new;
+    row_damage = damage;
+    term_rows = rows;
+    term_cols = cols;
+
+    cursor_row -= shift;
+    if (cursor_col >= cols) cursor_col = cols - 1;
+    // The cursor saved by 1049 moves with the text it was saved on
+    saved_cursor_row -= shift;
+    if (saved_cursor_row < 0) saved_cursor_row = 0;
+    if (saved_cursor_row >= rows) saved_cursor_row = rows - 1;
+    if (saved_cursor_col >= cols) saved_cursor_col = cols - 1;
+    scroll_top = 0;
+    scroll_bottom = rows - 1;
+    return 0;
+}
+
+static int cell_equal(const struct term_cell *a, const struct term_cell *b) {
+    return a->ch == b->ch && a->attrs == b->attrs;
+}
+
+// Erased cells keep the pen's background
+static void clear_cell(struct term_cell *cell) {
+    cell->ch = ' ';
+    cell->attrs = pen_bg;
+}
+
+static void damage_span(int row, int col_start, int col_end) {
+    if (row < 0 || row >= term_rows) return;
+    if (col_start < 0) col_start = 0;
+    if (col_end > term_cols) col_end = term_cols;
+    if (col_start >= col_end) return;
+
+    if (row_damage[row].start >= row_damage[row].end) {
+        row_damage[row].start = col_start;
+        row_damage[row].end = col_end;
+    } else {
+        if (col_start < row_damage[row].start) row_damage[row].start = col_start;
+        if (col_end > row_damage[row].end) row_damage[row].end = col_end;
+    }
+    damage_pending = 1;
+
+    // The scrollback view shows the top of the live grid below the history
+    if (view_offset > 0 && row < term_rows - view_offset) {
+        view_dirty = 1;
+    }
+}
+
+static void damage_rows(int row_start, int row_end) {
+    for (int r = row_start; r < row_end; r++) {
+        damage_span(r, 0, term_cols);
+    }
+}
+
+// Rasterize one cell (two for a wide character) straight into the
+// framebuffer. Cells are whole bytes wide, so every glyph row is a few
+// stores that also clear the old pixels underneath it.
+static void draw_cell(int row, int col, const struct term_cell *cell, int cells) {
+    uint32_t ch = cell->ch;
+    uint8_t attrs = cell->attrs;
+    int row_bytes = cell_bytes * cells;
+
+    // Attributes become a few masks applied to every glyph byte, so styled
+    // text costs the same per row as plain text. Framebuffer bits are 1 for
+    // white and glyph bits are 1 for ink, so plain text is inverted.
+    uint8_t invert = (attrs & ATTR_REVERSE) ? 0x00 : 0xFF;
+    uint8_t bold = (attrs & ATTR_BOLD) ? 0xFF : 0x00;      // smear one pixel right
+    uint8_t dim_even = (attrs & ATTR_DIM) ? 0xAA : 0xFF;   // checkerboard stipple
+    uint8_t dim_odd = (attrs & ATTR_DIM) ? 0x55 : 0xFF;
+    int underline_row = (attrs & ATTR_UNDERLINE) ? cell_height - 2 : -1;
+    int strike_row = (attrs & ATTR_STRIKE) ? cell_height / 2 : -1;
+
+    // Compiled table first (built-in font8x16 for ASCII when none is
+    // selected), then the FreeType-backed cache for everything else.
+    // Compiled glyphs are one cell wide, wide ones only come from the cache.
+    const uint8_t *glyph = NULL;
+    int glyph_bytes = cell_bytes;
+    if (cells == 1) {
+        if (font) {
+            glyph = font_table_glyph(font, ch);
+        } else if (ch >= 0x20 && ch <= 0x7F) {
+            glyph = font8x16[ch - 0x20];
+        }
+    }
+    if (!glyph) {
+        glyph = glyph_cache_lookup(ch, cells == 2);
+        glyph_bytes = row_bytes;
+    }
+    if (!glyph) {
+        // Nothing can draw it
+        glyph = font ? font_table_glyph(font, '?') : font8x16['?' - 0x20];
+        glyph_bytes = cell_bytes;
+    }
+
+    uint8_t *dst = framebuffer + (row * cell_height) * FB_STRIDE + col * cell_bytes;
+    for (int y = 0; y < cell_height; y++) {
+        uint8_t dim = (y & 1) ? dim_odd : dim_even;
+        uint8_t line = (y == underline_row || y == strike_row) ? 0xFF : 0x00;
+        uint8_t carry = 0;
+        for (int x = 0; x < row_bytes; x++) {
+            uint8_t bits = (glyph && x < glyph_bytes) ? glyph[x] : 0;
+            uint8_t smeared = bits | (((bits >> 1) | carry) & bold);
+            carry = bits << 7;
+            dst[x] = ((smeared & dim) | line) ^ invert;
+        }
+        if (glyph) glyph += glyph_bytes;
+        dst += FB_STRIDE;
+    }
+}
+
+// Draw columns start..end-1 of a grid row. A wide leader is drawn across
+// its continuation cell; halves split apart by later edits draw on their own.
+static void draw_cells(int row, const struct term_cell *cells, int start, int end) {
+    for (int c = start; c < end; c++) {
+        const struct term_cell *cell = &cells[c];
+        if (cell->attrs & ATTR_WIDE_CONT) {
+            if (c > 0 && (cells[c - 1].attrs & ATTR_WIDE)) {
+                if (c == start) draw_cell(row, c - 1, &cells[c - 1], 2);
+                continue;
+            }
+            // Orphaned right half shows as blank
+            struct term_cell blank = *cell;
+            blank.ch = ' ';
+            blank.attrs &= ~ATTR_WIDE_CONT;
+            draw_cell(row, c, &blank, 1);
+            continue;
+        }
+        int wide = (cell->attrs & ATTR_WIDE) && c + 1 < term_cols &&
+                   (cells[c + 1].attrs & ATTR_WIDE_CONT);
+        draw_cell(row, c, cell, wide ? 2 : 1);
+        if (wide) c++;
+    }
+}
+
+// Writing over either half of a wide character breaks the pair; blank the
+// other half so no stale half glyph is left behind
+static void split_wide(int row, int col) {
+    struct term_cell *cells = screen_buffer[row];
+    if ((cells[col].attrs & ATTR_WIDE_CONT) && col > 0 && (cells[col - 1].attrs & ATTR_WIDE)) {
+        clear_cell(&cells[col - 1]);
+        damage_span(row, col - 1, col);
+    }
+    if ((cells[col].attrs & ATTR_WIDE) && col + 1 < term_cols &&
+        (cells[col + 1].attrs & ATTR_WIDE_CONT)) {
+        clear_cell(&cells[col + 1]);
+        damage_span(row, col + 1, col + 2);
+    }
+}
+
+static void line_feed(void) {
+    if (cursor_row == scroll_bottom) {
+        // Full-screen programs on the alternate screen don't leave history
+        scroll_region_up(scroll_top, scroll_bottom, 1, scroll_top == 0 && !alt_screen_active);
+    } else if (cursor_row < term_rows - 1) {
+        cursor_row++;
+    }
+}
+
+// Move rendered pixel rows along with the grid rows they belong to
+static void move_pixel_rows(int dst_row, int src_row, int rows) {
+    // While history is shown the framebuffer holds the view, not the grid;
+    // leaving the view repaints every row
+    if (!framebuffer || rows <= 0 || view_offset > 0) return;
+
+    size_t row_bytes = cell_height * FB_STRIDE;
+    memmove(framebuffer + dst_row * row_bytes, framebuffer + src_row * row_bytes,
+            rows * row_bytes);
+
+    struct display_rect moved = {
+        0, dst_row * cell_height,
+        term_cols * cell_width, (dst_row + rows) * cell_height
+    };
+    display_rect_union(&moved_rect, &moved);
+    damage_pending = 1;
+}
+
+// Scroll rows [top, bottom] up by n. Row pointers, their pending damage and
+// their already rendered pixels each move with one memmove; only the n rows
+// coming in blank at the bottom need rasterizing.
+static void scroll_region_up(int top, int bottom, int n, int keep_history) {
+    int height = bottom - top + 1;
+    if (n > height) n = height;
+    if (n <= 0) return;
+
+    // Predicted pixels would move with the rows; damage them while the
+    // damage still moves along too
+    cancel_predictions(0);
+
+    struct term_cell *recycled[n];
+    int followed = 0;
+    for (int i = 0; i < n; i++) {
+        recycled[i] = screen_buffer[top + i];
+        if (keep_history) {
+            scrollback_push(recycled[i], term_cols);
+            if (view_offset > 0 && view_offset < scrollback_count()) {
+                view_offset++; // keep the viewport on the same history lines
+                followed++;
+            }
+        }
+    }
+
+    // The view only stays put when it followed every line of a whole
+    // screen scroll; otherwise the live rows it shows have moved
+    int whole_screen = top == 0 && bottom == term_rows - 1;
+    if (view_offset > 0 && top < term_rows - view_offset &&
+        !(whole_screen && followed == n)) {
+        view_dirty = 1;
+    }
+
+    memmove(&screen_buffer[top], &screen_buffer[top + n], (height - n) * sizeof(*screen_buffer));
+    memmove(&row_damage[top], &row_damage[top + n], (height - n) * sizeof(*row_damage));
+    move_pixel_rows(top, top + n, height - n);
+
+    for (int i = 0; i < n; i++) {
+        int r = bottom - n + 1 + i;
+        screen_buffer[r] = recycled[i];
+        for (int c = 0; c < term_cols; c++) {
+            clear_cell(&screen_buffer[r][c]);
+        }
+        row_damage[r].start = row_damage[r].end = 0;
+        damage_span(r, 0, term_cols);
+    }
+}
+
+// Scroll rows [top, bottom] down by n, blank rows come in at the top
+static void scroll_region_down(int top, int bottom, int n) {
+    int height = bottom - top + 1;
+    if (n > height) n = height;
+    if (n <= 0) return;
+
+    cancel_predictions(0);
+
+    struct term_cell *recycled[n];
+    memcpy(recycled, &screen_buffer[bottom - n + 1], n * sizeof(*screen_buffer));
+
+    if (view_offset > 0 && top < term_rows - view_offset) {
+        view_dirty = 1;
+    }
+
+    memmove(&screen_buffer[top + n], &screen_buffer[top], (height - n) * sizeof(*screen_buffer));
+    memmove(&row_damage[top + n], &row_damage[top], (height - n) * sizeof(*row_damage));
+    move_pixel_rows(top + n, top, height - n);
+
+    for (int i = 0; i < n; i++) {
+        int r = top + i;
+        screen_buffer[r] = recycled[i];
+        for (int c = 0; c < term_cols; c++) {
+            clear_cell(&screen_buffer[r][c]);
+        }
+        row_damage[r].start = row_damage[r].end = 0;
+        damage_span(r, 0, term_cols);
+    }
+}
+
+// ICH: open n blank cells at the cursor, pushing the rest of the line right
+static void insert_chars(int n) {
+    struct term_cell *line = screen_buffer[cursor_row];
+    int avail = term_cols - cursor_col;
+    if (n > avail) n = avail;
+    if (n <= 0) return;
+
+    // Wide pairs cut at the cursor or pushed half off the right edge. A
+    // right half at the cursor would move on without its left half.
+    split_wide(cursor_row, cursor_col);
+    if (line[cursor_col].attrs & ATTR_WIDE_CONT) {
+        clear_cell(&line[cursor_col]);
+    }
+    split_wide(cursor_row, term_cols - n);
+    memmove(&line[cursor_col + n], &line[cursor_col], (avail - n) * sizeof(*line));
+    for (int c = cursor_col; c < cursor_col + n; c++) {
+        clear_cell(&line[c]);
+    }
+    damage_span(cursor_row, cursor_col, term_cols);
+}
+
+// DCH: remove n cells at the cursor, pulling the rest of the line left
+static void delete_chars(int n) {
+    struct term_cell *line = screen_buffer[cursor_row];
+    int avail = term_cols - cursor_col;
+    if (n > avail) n = avail;
+    if (n <= 0) return;
+
+    // Wide pairs cut at either end of the deleted cells
+    split_wide(cursor_row, cursor_col);
+    split_wide(cursor_row, cursor_col + n - 1);
+    memmove(&line[cursor_col], &line[cursor_col + n], (avail - n) * sizeof(*line));
+    for (int c = term_cols - n; c < term_cols; c++) {
+        clear_cell(&line[c]);
+    }
+    damage_span(cursor_row, cursor_col, term_cols);
+}
+
+// ECH: blank n cells from the cursor without moving anything
+static void erase_chars(int n) {
+    int end = cursor_col + n;
+    if (end > term_cols) end = term_cols;
+    if (end <= cursor_col) return;
+
+    split_wide(cursor_row, cursor_col);
+    split_wide(cursor_row, end - 1);
+    for (int c = cursor_col; c < end; c++) {
+        clear_cell(&screen_buffer[cursor_row][c]);
+    }
+    damage_span(cursor_row, cursor_col, end);
+}
+
+static void clear_screen(void) {
+    cancel_predictions(0);
+    for (int r = 0; r < term_rows; r++) {
+        for (int c = 0; c < term_cols; c++) {
+            clear_cell(&screen_buffer[r][c]);
+        }
+    }
+    cursor_row = 0;
+    cursor_col = 0;
+    damage_rows(0, term_rows);
+}
+
+static void move_cursor(int row, int col) {
+    if (row >= 0 && row < term_rows) {
+        cursor_row = row;
+    }
+    if (col >= 0 && col < term_cols) {
+        cursor_col = col;
+    }
+}
+
+// Split "1;2;3" into numbers, empty fields count as 0. Stops at the first
+// character that is neither a digit nor ';'.
+static int parse_params(const char *seq, int *params, int max_params) {
+    int count = 0;
+    int value = 0;
+    int have_field = 0;
+
+    for (const char *p = seq; ; p++) {
+        if (*p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            have_field = 1;
+        } else if (*p == ';' || have_field || count > 0) {
+            if (count < max_params) {
+                params[count++] = value;
+            }
+            value = 0;
+            have_field = 0;
+            if (*p != ';') break;
+        } else {
+            break;
+        }
+    }
+    return count;
+}
+
+// Switch between the primary and alternate grids by swapping pointers. Only
+// cells whose content differs between the two are damaged, since everything
+// not already damaged on the outgoing grid is exactly what the panel shows.
+static void set_alt_screen(int enable, int clear, int save_cursor) {
+    if (enable == alt_screen_active) return;
+
+    cancel_predictions(1);
+
+    if (!alt_buffer) {
+        if (new_grid(&alt_buffer, &alt_storage, NULL, 0, 0, term_rows, term_cols, 0) != 0) {
+            log_error("set_alt_screen: out of memory");
+            return;
+        }
+    }
+
+    if (enable && save_cursor) {
+        saved_cursor_row = cursor_row;
+        saved_cursor_col = cursor_col;
+    }
+    if (enable && clear) {
+        for (int r = 0; r < term_rows; r++) {
+            for (int c = 0; c < term_cols; c++) {
+                clear_cell(&alt_buffer[r][c]);
+            }
+        }
+    }
+
+    struct term_cell **shown = screen_buffer;
+    struct term_cell *shown_storage = cell_storage;
+    screen_buffer = alt_buffer;
+    cell_storage = alt_storage;
+    alt_buffer = shown;
+    alt_storage = shown_storage;
+    alt_screen_active = enable;
+
+    for (int r = 0; r < term_rows; r++) {
+        int start = term_cols, end = 0;
+        for (int c = 0; c < term_cols; c++) {
+            if (!cell_equal(&screen_buffer[r][c], &alt_buffer[r][c])) {
+                if (c < start) start = c;
+                end = c + 1;
+            }
+        }
+        damage_span(r, start, end);
+    }
+
+    if (!enable && save_cursor) {
+        cursor_row = saved_cursor_row < term_rows ? saved_cursor_row : term_rows - 1;
+        cursor_col = saved_cursor_col < term_cols ? saved_cursor_col : term_cols - 1;
+    }
+}
+
+static void set_private_mode(int mode, int enable) {
+    switch (mode) {
+        case 1:    // Application cursor keys
+            key_modes = enable ? (key_modes | KEYMAP_APP_CURSOR) : (key_modes & ~KEYMAP_APP_CURSOR);
+            break;
+        case 47:   // Alternate screen
+            set_alt_screen(enable, 0, 0);
+            break;
+        case 1047: // Alternate screen, cleared on entry
+            set_alt_screen(enable, 1, 0);
+            break;
+        case 1049: // Alternate screen with saved cursor, cleared on entry
+            set_alt_screen(enable, 1, 1);
+            break;
+        case 2026: // Synchronized update
+            if (sync_update_active && !enable) {
+                sync_frame_complete = 1;
+            }
+            sync_update_active = enable;
+            break;
+        default:
+            trace(TRACE_MODE_UNHANDLED, mode, enable);
+            log_debug("Unhandled private mode: %d", mode);
+            break;
+    }
+}
+
+// DECRQM answer for a private mode: 1 = set, 2 = reset, 0 = not recognized
+static int private_mode_state(int mode) {
+    switch (mode) {
+        case 47:
+        case 1047:
+        case 1049:
+            return alt_screen_active ? 1 : 2;
+        case 1:
+            return (key_modes & KEYMAP_APP_CURSOR) ? 1 : 2;
+        case 2026:
+            return sync_update_active ? 1 : 2;
+        case 7:    // Autowrap is always on
+            return 3;
+        case 25:   // No cursor is ever drawn on the panel
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// Replies are queued with the key input and written at the end of the
+// loop turn that parsed the query, before any refresh
+static void send_reply(const char *fmt, ...) {
+    if (pty_fd < 0) return;
+
+    char reply[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(reply, sizeof(reply), fmt, args);
+    va_end(args);
+    if (len <= 0) return;
+    if (len >= (int)sizeof(reply)) len = sizeof(reply) - 1;
+
+    queue_input(reply, len);
+}
+
+// Device status and identification queries. seq holds the parameters,
+// including any '?', '>' or '=' prefix and '$' intermediate.
+static void answer_query(char cmd, const char *seq, int len) {
+    char prefix = (seq[0] == '?' || seq[0] == '>' || seq[0] == '=') ? seq[0] : 0;
+    const char *params = prefix ? seq + 1 : seq;
+    int n = 0;
+    sscanf(params, "%d", &n);
+
+    switch (cmd) {
+        case 'c':
+            if (n != 0) break;
+            if (prefix == 0) {
+                // DA1: VT220 class with ANSI color
+                send_reply("\x1b[?62;22c");
+            } else if (prefix == '>') {
+                // DA2: terminal type 1 (VT220), firmware 10, no ROM cartridge
+                send_reply("\x1b[>1;10;0c");
+            } else if (prefix == '=') {
+                // DA3: unit id
+                send_reply("\x1bP!|00000000\x1b\\");
+            }
+            break;
+
+        case 'n':
+            if (prefix == 0 && n == 5) {
+                send_reply("\x1b[0n"); // Status OK
+            } else if (prefix == 0 && n == 6) {
+                send_reply("\x1b[%d;%dR", cursor_row + 1, cursor_col + 1);
+            } else if (prefix == '?' && n == 6) {
+                send_reply("\x1b[?%d;%d;1R", cursor_row + 1, cursor_col + 1);
+            }
+            break;
+
+        case 'p': // DECRQM: CSI [?] Ps $ p
+            if (len >= 2 && seq[len - 2] == '$') {
+                if (prefix == '?') {
+                    send_reply("\x1b[?%d;%d$y", n, private_mode_state(n));
+                } else if (prefix == 0) {
+                    send_reply("\x1b[%d;0$y", n); // no ANSI modes are settable
+                }
+            }
+            break;
+
+        case 'q': // XTVERSION: CSI > q
+            if (prefix == '>' && n == 0) {
+                send_reply("\x1bP>|" TERM_NAME "(" TERM_VERSION ")\x1b\\");
+            }
+            break;
+
+        case 't': // XTWINOPS size reports
+            if (prefix != 0) break;
+            if (n == 14) {
+                send_reply("\x1b[4;%d;%dt", term_rows * cell_height, term_cols * cell_width);
+            } else if (n == 16) {
+                send_reply("\x1b[6;%d;%dt", cell_height, cell_width);
+            } else if (n == 18) {
+                send_reply("\x1b[8;%d;%dt", term_rows, term_cols);
+            }
+            break;
+    }
+}
+
+static void process_osc_sequence(const char *seq) {
+    int number = -1;
+    const char *arg = strchr(seq, ';');
+    sscanf(seq, "%d", &number);
+    if ((number == 10 || number == 11) && arg && strcmp(arg + 1, "?") == 0) {
+        // Default foreground/background query: black ink on white paper
+        send_reply("\x1b]%d;rgb:%s\x1b\\", number,
+                   number == 10 ? "0000/0000/0000" : "ffff/ffff/ffff");
+        return;
+    }
+    if (number != EPD_OSC_NUMBER || !arg) {
+        return; // titles, colors etc. have nothing to show on this panel
+    }
+    arg++;
+
+    if (strcmp(arg, "full") == 0) {
+        force_full_refresh = 1;
+        sync_frame_complete = 1;
+        damage_pending = 1;
+    } else if (strcmp(arg, "pause") == 0) {
+        refresh_paused = 1;
+    } else if (strcmp(arg, "resume") == 0) {
+        refresh_paused = 0;
+    } else if (strcmp(arg, "mode=auto") == 0) {
+        refresh_mode = DISPLAY_MODE_AUTO;
+    } else if (strcmp(arg, "mode=fast") == 0) {
+        refresh_mode = DISPLAY_MODE_FAST;
+    } else if (strcmp(arg, "mode=partial") == 0) {
+        refresh_mode = DISPLAY_MODE_PARTIAL;
+    } else if (strcmp(arg, "mode=quality") == 0) {
+        refresh_mode = DISPLAY_MODE_QUALITY;
+    } else if (strcmp(arg, "colors=mono") == 0) {
+        color_policy = COLOR_POLICY_MONO;
+    } else if (strcmp(arg, "colors=gray") == 0) {
+        color_policy = COLOR_POLICY_GRAY;
+    } else {
+        log_warn("Unknown refresh hint: %s", arg);
+    }
+}
+
+// Luminance (0-255) of an xterm 256-color palette entry
+static int palette_luminance(int index) {
+    static const uint8_t base[16][3] = {
+        {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+        {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+        {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+        {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+    };
+    int r, g, b;
+    if (index < 16) {
+        r = base[index][0];
+        g = base[index][1];
+        b = base[index][2];
+    } else if (index < 232) {
+        static const uint8_t level[6] = {0, 95, 135, 175, 215, 255};
+        index -= 16;
+        r = level[index / 36];
+        g = level[(index / 6) % 6];
+        b = level[index % 6];
+    } else {
+        r = g = b = 8 + (index - 232) * 10;
+    }
+    return (r * 299 + g * 587 + b * 114) / 1000;
+}
+
+// Fold a foreground or background color (luminance, or -1 for the
+// default) into the pen according to the color policy
+static void set_pen_color(int background, int luminance) {
+    if (background) {
+        if (luminance < 0) {
+            pen_bg = 0;
+        } else if (color_policy == COLOR_POLICY_MONO) {
+            pen_bg = (luminance >= 229) ? 0 : ATTR_REVERSE;
+        } else {
+            pen_bg = (luminance < 128) ? ATTR_REVERSE : 0;
+        }
+    } else {
+        pen_fg = (color_policy == COLOR_POLICY_GRAY && luminance >= 128) ? ATTR_DIM : 0;
+    }
+}
+
+// SGR: style bits and colors into the pen
+static void set_graphics(const char *seq, int len) {
+    int params[32];
+    int count = (len > 0) ? parse_params(seq, params, 32) : 0;
+    if (count == 0) {
+        params[0] = 0;
+        count = 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int p = params[i];
+        switch (p) {
+            case 0:  pen_style = pen_fg = pen_bg = 0; break;
+            case 1:  pen_style |= ATTR_BOLD; break;
+            case 2:  pen_style |= ATTR_DIM; break;
+            case 4:
+            case 21: pen_style |= ATTR_UNDERLINE; break;
+            case 7:  pen_style |= ATTR_REVERSE; break;
+            case 9:  pen_style |= ATTR_STRIKE; break;
+            case 22: pen_style &= ~(ATTR_BOLD | ATTR_DIM); break;
+            case 24: pen_style &= ~ATTR_UNDERLINE; break;
+            case 27: pen_style &= ~ATTR_REVERSE; break;
+            case 29: pen_style &= ~ATTR_STRIKE; break;
+            case 39: set_pen_color(0, -1); break;
+            case 49: set_pen_color(1, -1); break;
+            case 38:
+            case 48:
+                // 38;5;n or 38;2;r;g;b
+                if (i + 2 < count && params[i + 1] == 5) {
+                    set_pen_color(p == 48, palette_luminance(params[i + 2] & 0xFF));
+                    i += 2;
+                } else if (i + 4 < count && params[i + 1] == 2) {
+                    set_pen_color(p == 48, (params[i + 2] * 299 + params[i + 3] * 587 +
+                                            params[i + 4] * 114) / 1000);
+                    i += 4;
+                } else {
+                    i = count;
+                }
+                break;
+            default:
+                if (p >= 30 && p <= 37) set_pen_color(0, palette_luminance(p - 30));
+                else if (p >= 40 && p <= 47) set_pen_color(1, palette_luminance(p - 40));
+                else if (p >= 90 && p <= 97) set_pen_color(0, palette_luminance(p - 90 + 8));
+                else if (p >= 100 && p <= 107) set_pen_color(1, palette_luminance(p - 100 + 8));
+                break;  // italic, blink etc. have no rendering here
+        }
+    }
+}
+
+static void process_csi_sequence(const char *seq, int len) {
+    if (len == 0) return;
     
     char cmd = seq[len - 1];
     
-    printf("CSI sequence: %.*s%c\n", len - 1, seq, cmd);
+    trace(TRACE_CSI, (unsigned char)cmd, len);
+    log_debug("CSI sequence: %.*s%c", len - 1, seq, cmd);
     
     switch (cmd) {
         case 'H': // Cursor position
@@ -590,118 +1825,223 @@ static void process_csi_sequence(const char *seq, int len) {
             {
                 int n = 0;
                 sscanf(seq, "%d", &n);
-                if (n == 0) { // Clear from cursor to end of line
-                    for (int c = cursor_col; c < term_cols; c++) {
-                        screen_buffer[cursor_row][c].ch = ' ';
+                // 0: cursor to end, 1: start to cursor, 2: whole line
+                int start = (n == 0) ? cursor_col : 0;
+                int end = (n == 1) ? cursor_col + 1 : term_cols;
+                if (end > term_cols) end = term_cols;
+                split_wide(cursor_row, start);
+                split_wide(cursor_row, end - 1);
+                for (int c = start; c < end; c++) {
+                    clear_cell(&screen_buffer[cursor_row][c]);
+                }
+                damage_span(cursor_row, start, end);
+            }
+            break;
+            
+        case 'r': // Set scroll region (DECSTBM)
+            {
+                int params[2] = { 0, 0 };
+                int count = parse_params(seq, params, 2);
+                int top = (count > 0 && params[0] > 0) ? params[0] - 1 : 0;
+                int bottom = (count > 1 && params[1] > 0) ? params[1] - 1 : term_rows - 1;
+                if (bottom >= term_rows) bottom = term_rows - 1;
+                if (top < bottom) {
+                    scroll_top = top;
+                    scroll_bottom = bottom;
+                    move_cursor(0, 0);
+                }
+            }
+            break;
+            
+        case 'L': // Insert lines
+        case 'M': // Delete lines
+            {
+                int n = 1;
+                sscanf(seq, "%d", &n);
+                if (n < 1) n = 1;
+                if (cursor_row >= scroll_top && cursor_row <= scroll_bottom) {
+                    if (cmd == 'L') {
+                        scroll_region_down(cursor_row, scroll_bottom, n);
+                    } else {
+                        scroll_region_up(cursor_row, scroll_bottom, n, 0);
                     }
-                    damage_pending = 1;
+                    cursor_col = 0;
+                }
+            }
+            break;
+            
+        case 'S': // Scroll up
+        case 'T': // Scroll down
+            {
+                int n = 1;
+                sscanf(seq, "%d", &n);
+                if (n < 1) n = 1;
+                if (cmd == 'S') {
+                    scroll_region_up(scroll_top, scroll_bottom, n,
+                                     scroll_top == 0 && !alt_screen_active);
+                } else {
+                    scroll_region_down(scroll_top, scroll_bottom, n);
+                }
+            }
+            break;
+            
+        case '@': // Insert characters
+        case 'P': // Delete characters
+        case 'X': // Erase characters
+            {
+                int n = 1;
+                sscanf(seq, "%d", &n);
+                if (n < 1) n = 1;
+                if (cmd == '@') {
+                    insert_chars(n);
+                } else if (cmd == 'P') {
+                    delete_chars(n);
+                } else {
+                    erase_chars(n);
                 }
             }
             break;
             
-        case 'm': // Set graphics mode (colors, etc.)
-            // For now, ignore color commands
+        case 'c': // Device attributes
+        case 'n': // Device status report
+        case 'p': // Mode request (DECRQM)
+        case 'q': // XTVERSION
+        case 't': // Window size reports
+            answer_query(cmd, seq, len);
+            break;
+            
+        case 'h': // Set mode
+        case 'l': // Reset mode
+            if (seq[0] == '?') {
+                int params[16];
+                int count = parse_params(seq + 1, params, 16);
+                for (int i = 0; i < count; i++) {
+                    set_private_mode(params[i], cmd == 'h');
+                }
+            }
+            break;
+            
+        case 'm': // Select graphic rendition
+            // Prefixed forms are other commands (CSI > 4;2 m is xterm's
+            // modifyOtherKeys) and must not reset the pen
+            if (len == 1 || (seq[0] >= '0' && seq[0] <= '9') || seq[0] == ';') {
+                set_graphics(seq, len - 1);
+            } else {
+                trace(TRACE_CSI_UNHANDLED, (unsigned char)cmd, len);
+                log_debug("Unhandled CSI %c m", seq[0]);
+            }
             break;
             
         default:
-            printf("Unhandled CSI command: %c\n", cmd);
+            trace(TRACE_CSI_UNHANDLED, (unsigned char)cmd, len);
+            log_debug("Unhandled CSI command: %c", cmd);
             break;
     }
 }
 
-static void render_screen(void) {
-    if (!framebuffer) return;
-    
-    // Clear framebuffer to white
-    memset(framebuffer, 0xFF, buffer_size);
-    
-    int rendered_chars = 0;
-    
+// Move the viewport by lines (positive = back into history). Each call is
+// one viewport repaint no matter how far it moves.
+static void scroll_view(int lines) {
+    int offset = view_offset + lines;
+    if (offset > scrollback_count()) offset = scrollback_count();
+    if (offset < 0) offset = 0;
+    if (offset == view_offset) return;
+
+    if (offset == 0) {
+        // Back to live: the grid may have changed underneath the view
+        free_view();
+        damage_rows(0, term_rows);
+    } else {
+        view_dirty = 1;
+    }
+    view_offset = offset;
+
+    log_debug("Scrollback view at -%d (%d lines, %zu of %zu bytes)", view_offset,
+           scrollback_count(), scrollback_memory_used(), scrollback_memory_limit());
+}
+
+static void free_view(void) {
+    free(view_rows);
+    free(view_storage);
+    view_rows = NULL;
+    view_storage = NULL;
+    view_dirty = 0;
+}
+
+// Paint the whole viewport from history plus the top of the live grid
+static int render_view(struct display_rect *rect) {
+    if (!view_dirty) return 0;
+
+    if (!view_storage) {
+        view_storage = malloc((size_t)term_rows * term_cols * sizeof(*view_storage));
+        view_rows = malloc(term_rows * sizeof(*view_rows));
+        if (!view_storage || !view_rows) {
+            free_view();
+            return 0;
+        }
+        for (int r = 0; r < term_rows; r++) {
+            view_rows[r] = view_storage + (size_t)r * term_cols;
+        }
+    }
+
     for (int r = 0; r < term_rows; r++) {
-        for (int c = 0; c < term_cols; c++) {
-            if (screen_buffer[r][c].ch != ' ') {
-                int x = c * CELL_WIDTH;
-                int y = r * CELL_HEIGHT;
-                
-                if (x < EPD_7IN5_V2_WIDTH && y < EPD_7IN5_V2_HEIGHT) {
-                    draw_char(x, y, screen_buffer[r][c].ch,
-                             screen_buffer[r][c].fg_color,
-                             screen_buffer[r][c].bg_color,
-                             screen_buffer[r][c].attrs);
-                    rendered_chars++;
-                }
-            }
+        if (r < view_offset) {
+            scrollback_get(view_offset - 1 - r, view_rows[r], term_cols);
+        } else {
+            memcpy(view_rows[r], screen_buffer[r - view_offset],
+                   term_cols * sizeof(*view_storage));
         }
+        draw_cells(r, view_rows[r], 0, term_cols);
     }
+    view_dirty = 0;
+
+    rect->x_start = rect->y_start = 0;
+    rect->x_end = term_cols * cell_width;
+    rect->y_end = term_rows * cell_height;
+    return 1;
+}
+
+// Re-rasterize only the damaged spans and report the pixel area touched
+static int render_screen(struct display_rect *rect) {
+    rect->x_start = rect->y_start = rect->x_end = rect->y_end = 0;
+    if (!framebuffer) return 0;
+    if (view_offset > 0) return render_view(rect);
+    if (!damage_pending) return 0;
     
-    printf("Rendered %d characters\n", rendered_chars);
-}
-
-// Complete key mapping table for Linux input event codes to ASCII
-static char keycode_to_ascii(uint32_t keycode, int shift_pressed) {
-    // Handle letters (KEY_Q=16, KEY_W=17, KEY_E=18, etc.)
-    switch (keycode) {
-        // QWERTY row 1
-        case KEY_Q: return shift_pressed ? 'Q' : 'q';
-        case KEY_W: return shift_pressed ? 'W' : 'w';
-        case KEY_E: return shift_pressed ? 'E' : 'e';
-        case KEY_R: return shift_pressed ? 'R' : 'r';
-        case KEY_T: return shift_pressed ? 'T' : 't';
-        case KEY_Y: return shift_pressed ? 'Y' : 'y';
-        case KEY_U: return shift_pressed ? 'U' : 'u';
-        case KEY_I: return shift_pressed ? 'I' : 'i';
-        case KEY_O: return shift_pressed ? 'O' : 'o';
-        case KEY_P: return shift_pressed ? 'P' : 'p';
-        
-        // QWERTY row 2
-        case KEY_A: return shift_pressed ? 'A' : 'a';
-        case KEY_S: return shift_pressed ? 'S' : 's';
-        case KEY_D: return shift_pressed ? 'D' : 'd';
-        case KEY_F: return shift_pressed ? 'F' : 'f';
-        case KEY_G: return shift_pressed ? 'G' : 'g';
-        case KEY_H: return shift_pressed ? 'H' : 'h';
-        case KEY_J: return shift_pressed ? 'J' : 'j';
-        case KEY_K: return shift_pressed ? 'K' : 'k';
-        case KEY_L: return shift_pressed ? 'L' : 'l';
-        
-        // QWERTY row 3
-        case KEY_Z: return shift_pressed ? 'Z' : 'z';
-        case KEY_X: return shift_pressed ? 'X' : 'x';
-        case KEY_C: return shift_pressed ? 'C' : 'c';
-        case KEY_V: return shift_pressed ? 'V' : 'v';
-        case KEY_B: return shift_pressed ? 'B' : 'b';
-        case KEY_N: return shift_pressed ? 'N' : 'n';
-        case KEY_M: return shift_pressed ? 'M' : 'm';
-    }
+    int rendered_cells = 0;
+    *rect = moved_rect;
+    moved_rect.x_start = moved_rect.y_start = moved_rect.x_end = moved_rect.y_end = 0;
     
-    // Handle numbers and their shifted symbols
-    switch (keycode) {
-        case KEY_1: return shift_pressed ? '!' : '1';
-        case KEY_2: return shift_pressed ? '@' : '2';
-        case KEY_3: return shift_pressed ? '#' : '3';
-        case KEY_4: return shift_pressed ? '$' : '4';
-        case KEY_5: return shift_pressed ? '%' : '5';
-        case KEY_6: return shift_pressed ? '^' : '6';
-        case KEY_7: return shift_pressed ? '&' : '7';
-        case KEY_8: return shift_pressed ? '*' : '8';
-        case KEY_9: return shift_pressed ? '(' : '9';
-        case KEY_0: return shift_pressed ? ')' : '0';
+    for (int r = 0; r < term_rows; r++) {
+        int start = row_damage[r].start;
+        int end = row_damage[r].end;
+        if (start >= end) continue;
+
+        // A damaged half of a wide character redraws the whole character
+        if (start > 0 && (screen_buffer[r][start].attrs & ATTR_WIDE_CONT)) start--;
+        if (end < term_cols && (screen_buffer[r][end - 1].attrs & ATTR_WIDE)) end++;
+
+        draw_cells(r, screen_buffer[r], start, end);
+        rendered_cells += end - start;
+
+        struct display_rect span = {
+            start * cell_width, r * cell_height,
+            end * cell_width, (r + 1) * cell_height
+        };
+        display_rect_union(rect, &span);
+        row_damage[r].start = row_damage[r].end = 0;
+    }
+    damage_pending = 0;
+    draw_predictions(rect);
+
+    if (panel_damaged) {
+        rect->x_start = rect->y_start = 0;
+        rect->x_end = EPD_7IN5_V2_WIDTH;
+        rect->y_end = EPD_7IN5_V2_HEIGHT;
+        panel_damaged = 0;
     }
     
-    // Handle special characters and punctuation
-    switch (keycode) {
-        case KEY_SPACE: return ' ';
-        case KEY_MINUS: return shift_pressed ? '_' : '-';
-        case KEY_EQUAL: return shift_pressed ? '+' : '=';
-        case KEY_LEFTBRACE: return shift_pressed ? '{' : '[';
-        case KEY_RIGHTBRACE: return shift_pressed ? '}' : ']';
-        case KEY_BACKSLASH: return shift_pressed ? '|' : '\\';
-        case KEY_SEMICOLON: return shift_pressed ? ':' : ';';
-        case KEY_APOSTROPHE: return shift_pressed ? '"' : '\'';
-        case KEY_GRAVE: return shift_pressed ? '~' : '`';
-        case KEY_COMMA: return shift_pressed ? '<' : ',';
-        case KEY_DOT: return shift_pressed ? '>' : '.';
-        case KEY_SLASH: return shift_pressed ? '?' : '/';
-        default: return 0;
-    }
-}
\ No newline at end of file
+    trace(TRACE_RENDER, rendered_cells, 0);
+    return !display_rect_is_empty(rect);
+}
+
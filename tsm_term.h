@@ -3,24 +3,101 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "display.h"
 
 // Initialize TSM-based terminal emulator
 int tsm_term_init(int rows, int cols, int pty_fd, uint8_t *buffer);
 void tsm_term_destroy(void);
 
-// Feed output from PTY to terminal
+// Select a font table compiled in by fontc ("mono16", "mono32", ...). Call
+// before tsm_term_grid_for_panel to size the grid; after init the grid is
+// resized to the new cell size.
+int tsm_term_set_font(const char *name);
+
+// Grid that fits a panel of the given pixel size with the current font
+void tsm_term_grid_for_panel(int width, int height, int *rows, int *cols);
+
+// Change the grid size (font switch, rotation) and tell the PTY about it
+int tsm_term_resize(int rows, int cols);
+
+// Queue output from the PTY; it is parsed by tsm_term_parse (and before
+// any render)
 void tsm_term_feed_output(const char *data, size_t len, uint8_t *buffer);
 
-// Process keyboard input
+// Room left in the output queue. Reading no more than this from the PTY
+// leaves the rest in the kernel, which throttles a flooding program.
+size_t tsm_term_output_space(void);
+
+// Parse queued output for at most max_bytes or about max_us microseconds
+// (0 = no limit). Returns the number of bytes still queued.
+size_t tsm_term_parse(size_t max_bytes, unsigned long max_us);
+
+// Process keyboard input. The bytes for the PTY are queued, not written.
 void tsm_term_process_input(uint32_t keycode, int modifiers);
 
-// Redraw terminal to framebuffer
-void tsm_term_redraw(uint8_t *buffer);
+// Write queued key input and query replies to the PTY, as much as it takes
+// without blocking. Call once per loop turn; tsm_term_input_pending says
+// how much is left (poll the PTY for POLLOUT while it isn't 0).
+void tsm_term_flush_input(void);
+size_t tsm_term_input_pending(void);
+
+// Push keystrokes drawn by local echo prediction to the panel as a small
+// partial refresh, and expire predictions whose echo never came. Call after
+// a batch of keys; while the panel is busy the cells wait for the next call.
+void tsm_term_flush_predictions(void);
+
+// Milliseconds until the oldest prediction expires and
+// tsm_term_flush_predictions should run again, -1 if none are pending
+long tsm_term_prediction_timeout(void);
+
+// Render pending damage and push it to the panel. Output still queued for
+// tsm_term_parse is not parsed here. mode is the caller's
+// waveform choice; an application override or a requested full refresh
+// takes precedence, and DISPLAY_MODE_AUTO picks by damage size. Returns
+// the mode used, or DISPLAY_MODE_AUTO if nothing was pushed.
+enum display_mode tsm_term_redraw(uint8_t *buffer, enum display_mode mode);
+
+// Pixel area the next redraw would push, without rendering anything.
+// Returns nonzero if there is any.
+int tsm_term_pending_area(struct display_rect *rect);
+
+// Re-rasterize damaged cells only (of the output parsed so far); fills rect
+// with the pixel area that was touched and returns nonzero if anything was
+// drawn
+int tsm_term_render(struct display_rect *rect);
 
 // Check if redraw is needed
 int tsm_term_has_pending_damage(void);
 
+// Synchronized update (DEC mode 2026): nonzero while the application has
+// a frame open and refreshes should be held
+int tsm_term_sync_update_active(void);
+
+// Returns 1 once when the application wants its frame shown now: it closed
+// a synchronized update or asked for a full refresh through the private OSC
+int tsm_term_take_frame_complete(void);
+
+// Nonzero while the application has paused refreshes through the private OSC
+int tsm_term_refresh_paused(void);
+
 // Display functions
 void tsm_flush_display(void);
 
+// Escape sequences counted by tsm_term_get_stats
+enum tsm_escape_type {
+    TSM_ESCAPE_CSI,
+    TSM_ESCAPE_OSC,
+    TSM_ESCAPE_OTHER,  // single-character escapes (ESC D, ESC =, ...)
+    TSM_ESCAPE_TYPE_COUNT
+};
+
+struct tsm_term_stats {
+    unsigned long long bytes_parsed;
+    unsigned long escapes[TSM_ESCAPE_TYPE_COUNT];
+    unsigned long frames;          // renders that drew something
+    unsigned long skipped_redraws; // redraws that had nothing to push
+};
+
+void tsm_term_get_stats(struct tsm_term_stats *stats);
+
 #endif // TSM_TERM_H
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "utf8.h"
+
+int utf8_encode(uint32_t codepoint, unsigned char *out) {
+    if (codepoint < 0x80) {
+        out[0] = codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = 0xC0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3F);
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = 0xE0 | (codepoint >> 12);
+        out[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        out[2] = 0x80 | (codepoint & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (codepoint >> 18);
+    out[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+    out[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+    out[3] = 0x80 | (codepoint & 0x3F);
+    return 4;
+}
+
+int utf8_decode(const unsigned char *in, uint32_t *codepoint) {
+    if (in[0] < 0x80) {
+        *codepoint = in[0];
+        return 1;
+    }
+    if (in[0] < 0xE0) {
+        *codepoint = ((in[0] & 0x1F) << 6) | (in[1] & 0x3F);
+        return 2;
+    }
+    if (in[0] < 0xF0) {
+        *codepoint = ((in[0] & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F);
+        return 3;
+    }
+    *codepoint = ((uint32_t)(in[0] & 0x07) << 18) | ((in[1] & 0x3F) << 12) |
+                 ((in[2] & 0x3F) << 6) | (in[3] & 0x3F);
+    return 4;
+}
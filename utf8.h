@@ -0,0 +1,13 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdint.h>
+
+// Encode a code point, returns the number of bytes written (1-4) to out
+int utf8_encode(uint32_t codepoint, unsigned char *out);
+
+// Decode one code point from well-formed UTF-8 (as produced by
+// utf8_encode), returns the number of bytes consumed
+int utf8_decode(const unsigned char *in, uint32_t *codepoint);
+
+#endif // UTF8_H
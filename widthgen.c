@@ -0,0 +1,81 @@
+// widthgen - build-time generator for the character width table
+//
+// Walks every code point through the build host's wcwidth() in a UTF-8
+// locale and writes a two-level lookup table (see char_width.h) to stdout:
+// the high bits of a code point pick a 256 code point block, identical
+// blocks are shared, and each block packs 2 bits of width per code point.
+//
+// usage: widthgen > char_width_table.c
+
+#define _XOPEN_SOURCE 700
+#include <locale.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#define MAX_CODEPOINT 0x10FFFF
+#define BLOCK_COUNT ((MAX_CODEPOINT >> 8) + 1)
+#define BLOCK_BYTES (256 / 4)
+#define MAX_UNIQUE_BLOCKS 256
+
+static uint8_t blocks[MAX_UNIQUE_BLOCKS][BLOCK_BYTES];
+static uint8_t block_index[BLOCK_COUNT];
+static int block_count = 0;
+
+static int width_of(uint32_t codepoint) {
+    // Surrogates never reach the terminal, controls never occupy a cell
+    if (codepoint >= 0xD800 && codepoint <= 0xDFFF) return 1;
+    int width = wcwidth((wchar_t)codepoint);
+    if (width < 0) return 1;
+    return width > 2 ? 2 : width;
+}
+
+int main(void) {
+    if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "en_US.UTF-8")) {
+        fprintf(stderr, "widthgen: no UTF-8 locale on the build host\n");
+        return 1;
+    }
+
+    for (int b = 0; b < BLOCK_COUNT; b++) {
+        uint8_t packed[BLOCK_BYTES] = {0};
+        for (int i = 0; i < 256; i++) {
+            packed[i / 4] |= width_of(((uint32_t)b << 8) | i) << ((i % 4) * 2);
+        }
+
+        int found = -1;
+        for (int u = 0; u < block_count; u++) {
+            if (memcmp(blocks[u], packed, BLOCK_BYTES) == 0) {
+                found = u;
+                break;
+            }
+        }
+        if (found < 0) {
+            if (block_count == MAX_UNIQUE_BLOCKS) {
+                fprintf(stderr, "widthgen: more than %d distinct blocks\n", MAX_UNIQUE_BLOCKS);
+                return 1;
+            }
+            memcpy(blocks[block_count], packed, BLOCK_BYTES);
+            found = block_count++;
+        }
+        block_index[b] = found;
+    }
+
+    printf("// Generated by widthgen - do not edit\n#include \"char_width.h\"\n\n");
+    printf("const uint8_t char_width_index[%d] = {", BLOCK_COUNT);
+    for (int b = 0; b < BLOCK_COUNT; b++) {
+        printf("%s%d,", b % 16 == 0 ? "\n    " : " ", block_index[b]);
+    }
+    printf("\n};\n\nconst uint8_t char_width_blocks[%d][%d] = {\n", block_count, BLOCK_BYTES);
+    for (int u = 0; u < block_count; u++) {
+        printf("    {");
+        for (int i = 0; i < BLOCK_BYTES; i++) {
+            printf("%s0x%02X,", i % 16 == 0 ? "\n        " : " ", blocks[u][i]);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n");
+
+    fprintf(stderr, "widthgen: %d blocks, %d distinct\n", BLOCK_COUNT, block_count);
+    return 0;
+}